@@ -0,0 +1,280 @@
+// Microbenchmarks for the hot paths of the GS.
+//
+// Every benchmark is run REPEATS times and reported as one JSON object per
+// line (or CSV with -c) with the median and best time per operation, so two
+// runs can be compared with any diff/plot tool.
+//
+// Usage: ./GSbench [-c] [-l] [-f filter]
+//   -c         CSV output instead of JSON lines
+//   -l         also run scoreboard::scan over 10^6 score files (slow to set up)
+//   -f filter  only run benchmarks whose name contains filter
+
+#include "../Server/server.hpp"
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include <chrono>
+#include <functional>
+#include <sys/wait.h>
+
+// Friend of Server: forwards to the private methods under test
+class ServerHarness {
+public:
+    static void countMatches(Server& s, const std::string& c1, const std::string& c2,
+                             const std::string& c3, const std::string& c4,
+                             const std::string& secret, int& nB, int& nW) {
+        s.countMatches(c1, c2, c3, c4, secret, nB, nW);
+    }
+    static std::string handleRequest(Server& s, const std::string& request, bool isTCP) {
+        return s.handleRequest(request, isTCP, nullptr);
+    }
+    static std::string formatTrials(Server& s, const std::vector<std::string>& lines) {
+        return s.formatTrials(lines);
+    }
+    static std::string handleScoreBoard(Server& s) {
+        return s.handleScoreBoard();
+    }
+    static void loadScoreBoard(Server& s) {
+        s.scoreBoard.load("Server/SCORES/");
+    }
+};
+
+namespace {
+    const int REPEATS = 5;
+
+    bool csv = false;
+    std::string filter;
+
+    // Defeats dead code elimination of benchmark results
+    volatile size_t sink;
+
+    void printHeader() {
+        if (csv) fprintf(stdout, "bench,param,iterations,ns_per_op,min_ns_per_op\n");
+    }
+
+    // Runs fn(iterations) REPEATS times and reports ns per iteration
+    void run(const std::string& name, const std::string& param, long iterations,
+             const std::function<void(long)>& fn) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+        std::vector<double> samples;
+        fn(iterations / 10 + 1); // warm up
+        for (int r = 0; r < REPEATS; r++) {
+            auto start = std::chrono::steady_clock::now();
+            fn(iterations);
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            samples.push_back(elapsed.count() / iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        if (csv) {
+            fprintf(stdout, "%s,%s,%ld,%.1f,%.1f\n", name.c_str(), param.c_str(),
+                    iterations, samples[REPEATS / 2], samples[0]);
+        } else {
+            fprintf(stdout, "{\"bench\":\"%s\",\"param\":\"%s\",\"iterations\":%ld,"
+                    "\"ns_per_op\":%.1f,\"min_ns_per_op\":%.1f}\n", name.c_str(), param.c_str(),
+                    iterations, samples[REPEATS / 2], samples[0]);
+        }
+        fflush(stdout);
+    }
+
+    // Fills Server/SCORES with n score files named like Game::saveScoreFile does
+    void makeScores(int n) {
+        system("rm -rf Server/SCORES && mkdir -p Server/SCORES");
+        std::mt19937 gen(42);
+        const char colors[] = "RGBYOP";
+        for (int i = 0; i < n; i++) {
+            int score = gen() % 101;
+            char plid[7], name[100];
+            snprintf(plid, sizeof(plid), "%06d", static_cast<int>(gen() % 1000000));
+            snprintf(name, sizeof(name), "Server/SCORES/%d_%s_%08d_%06d.txt", score, plid, i, i);
+            FILE* fp = fopen(name, "w");
+            if (!fp) {
+                perror("Cannot create score file");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(fp, "%03d %s %c %c %c %c %d %s\n", score, plid,
+                    colors[gen() % 6], colors[gen() % 6], colors[gen() % 6], colors[gen() % 6],
+                    static_cast<int>(gen() % 8) + 1, gen() % 2 ? "PLAY" : "DEBUG");
+            fclose(fp);
+        }
+    }
+
+    void benchCountMatches(Server& server) {
+        const char* colors[] = {"R", "G", "B", "Y", "O", "P"};
+        std::mt19937 gen(1);
+        std::vector<std::vector<std::string> > guesses(256);
+        std::vector<std::string> secrets(256);
+        for (int i = 0; i < 256; i++) {
+            for (int p = 0; p < 4; p++) guesses[i].push_back(colors[gen() % 6]);
+            secrets[i] = std::string(colors[gen() % 6]) + " " + colors[gen() % 6] + " " +
+                         colors[gen() % 6] + " " + colors[gen() % 6];
+        }
+        run("countMatches", "", 200000, [&](long n) {
+            int nB, nW;
+            size_t acc = 0;
+            for (long i = 0; i < n; i++) {
+                const std::vector<std::string>& g = guesses[i & 255];
+                ServerHarness::countMatches(server, g[0], g[1], g[2], g[3], secrets[(i >> 8) & 255], nB, nW);
+                acc += nB + nW;
+            }
+            sink = acc;
+        });
+    }
+
+    // Requests that fail validation right after parsing, so only the
+    // dispatch and argument parsing of each opcode is measured
+    void benchParsing(Server& server) {
+        const char* requests[][3] = {
+            {"SNG", "SNG 123456 0\n", "udp"},
+            {"TRY", "TRY 123456 R G B X 1\n", "udp"},
+            {"QUT", "QUT 12345\n", "udp"},
+            {"DBG", "DBG 123456 100 R G B X\n", "udp"},
+            {"HNT", "HNT 12345\n", "udp"},
+            {"STR", "STR 12345\n", "tcp"},
+            {"unknown", "XYZ 123456\n", "udp"},
+        };
+        for (size_t r = 0; r < sizeof(requests) / sizeof(requests[0]); r++) {
+            std::string request = requests[r][1];
+            bool isTCP = strcmp(requests[r][2], "tcp") == 0;
+            run("handleRequest", requests[r][0], 100000, [&](long n) {
+                size_t acc = 0;
+                for (long i = 0; i < n; i++) {
+                    acc += ServerHarness::handleRequest(server, request, isTCP).size();
+                }
+                sink = acc;
+            });
+        }
+    }
+
+    void benchRendering(Server& server) {
+        std::vector<std::string> lines;
+        lines.push_back("123456 P R G B Y 600 2024-01-01 10:00:00 1704103200");
+        for (int i = 0; i < MAX_ATTEMPTS; i++) {
+            lines.push_back("T: R G B Y 1 2 " + std::to_string(i * 7));
+        }
+        run("formatTrials", std::to_string(MAX_ATTEMPTS), 20000, [&](long n) {
+            size_t acc = 0;
+            for (long i = 0; i < n; i++) {
+                acc += ServerHarness::formatTrials(server, lines).size();
+            }
+            sink = acc;
+        });
+
+        makeScores(1000);
+        ServerHarness::loadScoreBoard(server);
+        run("handleScoreBoard", "1000", 50, [&](long n) {
+            size_t acc = 0;
+            for (long i = 0; i < n; i++) {
+                acc += ServerHarness::handleScoreBoard(server).size();
+            }
+            sink = acc;
+        });
+    }
+
+    void benchTopScores(Server& server, bool large) {
+        std::vector<int> sizes = {1000, 10000, 100000};
+        if (large) sizes.push_back(1000000);
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if (!filter.empty() && std::string("scoreboard::scan").find(filter) == std::string::npos) return;
+            makeScores(sizes[i]);
+            long iterations = std::max(1, 1000000 / sizes[i] / 10);
+            run("scoreboard::scan", std::to_string(sizes[i]), iterations, [&](long n) {
+                size_t acc = 0;
+                std::vector<scoreboard::Entry> top;
+                for (long k = 0; k < n; k++) {
+                    acc += scoreboard::scan("Server/SCORES/", top);
+                }
+                sink = acc;
+            });
+        }
+    }
+
+    // Framing cost of protocols::receiveTCPMessage and receiveTCPReply for
+    // replies of several sizes written over a local stream socket
+    void benchReceiveTCP() {
+        std::vector<int> sizes = {16, 1024, 65536};
+        for (size_t s = 0; s < sizes.size(); s++) {
+            std::string message(sizes[s] - 1, 'x');
+            message += '\n';
+            run("receiveTCPMessage", std::to_string(sizes[s]), 20000000 / (sizes[s] + 1000), [&](long n) {
+                size_t acc = 0;
+                for (long i = 0; i < n; i++) {
+                    int fds[2];
+                    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+                        perror("socketpair");
+                        exit(EXIT_FAILURE);
+                    }
+                    protocols::sendTCPMessage(fds[0], message);
+                    acc += protocols::receiveTCPMessage(fds[1]).size();
+                    close(fds[0]);
+                    close(fds[1]);
+                }
+                sink = acc;
+            });
+        }
+        // File replies read by their Fsize (the data holds newlines)
+        for (size_t s = 0; s < sizes.size(); s++) {
+            std::string data(sizes[s], '\n');
+            std::string message = "RSS OK scores.txt " + std::to_string(data.size()) + " " + data + "\n";
+            run("receiveTCPReply", std::to_string(sizes[s]), 20000000 / (sizes[s] + 1000), [&](long n) {
+                size_t acc = 0;
+                for (long i = 0; i < n; i++) {
+                    int fds[2];
+                    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+                        perror("socketpair");
+                        exit(EXIT_FAILURE);
+                    }
+                    protocols::sendTCPMessage(fds[0], message);
+                    acc += protocols::receiveTCPReply(fds[1]).size();
+                    close(fds[0]);
+                    close(fds[1]);
+                }
+                sink = acc;
+            });
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool large = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            csv = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            large = true;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-c] [-l] [-f filter]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Work in a scratch directory with the layout the server expects
+    char dir[] = "/tmp/gsbench.XXXXXX";
+    if (mkdtemp(dir) == nullptr || chdir(dir) == -1 || mkdir("Server", 0777) == -1) {
+        perror("Cannot create bench directory");
+        return 1;
+    }
+
+    // Handlers log to cout/cerr; keep the results alone on stdout
+    std::ofstream devnull("/dev/null");
+    std::streambuf* coutBuf = std::cout.rdbuf(devnull.rdbuf());
+    std::streambuf* cerrBuf = std::cerr.rdbuf(devnull.rdbuf());
+
+    {
+        Server server(false);
+        printHeader();
+        benchCountMatches(server);
+        benchParsing(server);
+        benchRendering(server);
+        benchTopScores(server, large);
+        benchReceiveTCP();
+    }
+
+    std::cout.rdbuf(coutBuf);
+    std::cerr.rdbuf(cerrBuf);
+    std::string cleanup = std::string("rm -rf ") + dir;
+    system(cleanup.c_str());
+    return 0;
+}
@@ -12,11 +12,16 @@ GameClient::GameClient(int argc, char** argv)
       udpSocket(-1),
       tcpSocket(-1), 
       nT(0), 
+      binary(false),
+      seq(0),
       udpRes(nullptr), 
       tcpRes(nullptr) {
     
     setupDirectory();
     parseArguments(argc, argv);
+}
+
+void GameClient::run() {
     setupUDPSocket();
     handleCommands();
     closeUDPSocket();
@@ -40,9 +45,14 @@ void GameClient::setupDirectory() {
     }
 }
 void GameClient::parseArguments(int argc, char** argv) {
-    if (argc > 1) {
-        serverIP = argv[2];
-        serverPort = atoi(argv[4]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            serverIP = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            serverPort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            binary = true;
+        }
     }
     fprintf(stdout, "Server IP: %s\n", serverIP.c_str());
     fprintf(stdout, "Server Port: %d\n", serverPort);
@@ -110,10 +120,132 @@ void GameClient::closeTCPSocket() {
     close(tcpSocket);
 }
 
+std::string GameClient::exchangeUDP(const std::string& request) {
+    // Requests without a binary form (or malformed ones) are sent as text
+    std::string frame = binary ? encodeBinaryRequest(request, ++seq) : "";
+    const std::string& message = frame.empty() ? request : frame;
+
+    // Every UDP request can be sent again: SNG/DBG restart a game without
+    // trials, a TRY resent with the same nT gets the same answer and HNT
+    // does not change the game
+    drainUDPSocket();
+    auto start = std::chrono::steady_clock::now();
+    auto giveUp = start + std::chrono::seconds(TIMEOUT_TIME);
+    int attempts = 0;
+    std::string busy;   // last BSY reply, retried after the timeout
+    while (true) {
+        auto sent = std::chrono::steady_clock::now();
+        auto retransmit = std::min(giveUp, sent + std::chrono::milliseconds(rtt.timeout()));
+        sendUDPMessage(udpSocket, message, (struct sockaddr_in*)udpRes->ai_addr, udpRes->ai_addrlen);
+        attempts++;
+
+        while (true) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                retransmit - std::chrono::steady_clock::now()).count();
+            struct pollfd pfd = {udpSocket, POLLIN, 0};
+            if (wait <= 0 || poll(&pfd, 1, wait) <= 0) break;
+
+            std::string response = receiveUDPMessage(udpSocket, (struct sockaddr_in*)udpRes->ai_addr, &udpRes->ai_addrlen);
+            if (!isReplyTo(response, request, frame)) continue;
+            if (attempts == 1) {
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - sent;
+                rtt.sample(elapsed.count());
+            }
+            std::string text = isBinaryFrame(response) ? binaryResponseToText(response) : response;
+            // The GS shed the request: send it again later, backing off
+            if (text.find(" " STATUS_BUSY "\n") != std::string::npos) {
+                busy = text;
+                continue;
+            }
+            return text;
+        }
+
+        if (std::chrono::steady_clock::now() >= giveUp) {
+            if (!busy.empty()) return busy;
+            std::cerr << "Request timed out after " << attempts << " attempts. Please try again\n";
+            return "Failed to receive UDP message.\n";
+        }
+        rtt.backoff();
+    }
+}
+
+// A reply to an earlier retransmitted request must not be taken as the
+// reply to this one: binary replies carry the sequence number, text ones
+// must answer the command sent and, for RTR OK, the trial sent
+bool GameClient::isReplyTo(const std::string& response, const std::string& request,
+                           const std::string& frame) {
+    if (!frame.empty() && isBinaryFrame(response)) {
+        BinaryHeader sent, received;
+        return decodeBinaryHeader(frame, sent) && decodeBinaryHeader(response, received) &&
+               sent.seq == received.seq;
+    }
+
+    static const char* REPLIES[][2] = {
+        {REQUEST_START, RESPONSE_START}, {REQUEST_TRY, RESPONSE_TRY}, {REQUEST_QUIT, RESPONSE_QUIT},
+        {REQUEST_DEBUG, RESPONSE_DEBUG}, {REQUEST_HINT, RESPONSE_HINT}, {REQUEST_BATCH, RESPONSE_BATCH}
+    };
+    char sentCommand[10] = "", command[10] = "", status[10] = "";
+    int sentTrial = 0, trial = 0;
+    sscanf(request.c_str(), "%9s", sentCommand);
+    sscanf(response.c_str(), "%9s %9s %d", command, status, &trial);
+    if (strcmp(command, "ERR") == 0) return true;   // the GS could not parse it
+
+    for (size_t i = 0; i < sizeof(REPLIES) / sizeof(REPLIES[0]); i++) {
+        if (strcmp(sentCommand, REPLIES[i][0]) != 0) continue;
+        if (strcmp(command, REPLIES[i][1]) != 0) return false;
+        if (strcmp(command, RESPONSE_TRY) == 0 && strcmp(status, STATUS_OK) == 0) {
+            sscanf(request.c_str(), "%*s %*s %*s %*s %*s %*s %d", &sentTrial);
+            return trial == sentTrial;
+        }
+        return true;
+    }
+    return true;
+}
+
+void GameClient::drainUDPSocket() {
+    char buffer[BUFFER_SIZE];
+    while (recv(udpSocket, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+}
+
+std::string GameClient::exchangeTCP(const std::string& request) {
+    setupTCPSocket();
+    std::string frame = binary ? encodeBinaryRequest(request, ++seq) : "";
+    sendTCPMessage(tcpSocket, frame.empty() ? request : frame);
+    std::string response = receiveTCPReply(tcpSocket);
+    closeTCPSocket();
+    return isBinaryFrame(response) ? binaryResponseToText(response) : response;
+}
+
+// Fname, and where the Fsize bytes of Fdata start, of a "CMD status Fname
+// Fsize Fdata" reply; false (reported) if malformed or shorter than Fsize
+bool GameClient::fileReply(const std::string& response, std::string& name, size_t& offset, size_t& size) {
+    char Fname[128];
+    unsigned long long Fsize;
+    int end = 0;
+    if (sscanf(response.c_str(), "%*s %*s %127s %llu%n", Fname, &Fsize, &end) != 2 ||
+        static_cast<size_t>(end) >= response.size() || response[end] != ' ') {
+        std::cerr << "Error: Malformed response - couldn't parse filename and size\n";
+        return false;
+    }
+    offset = end + 1;
+    if (response.size() - offset < Fsize) {
+        std::cerr << "Error: Received " << response.size() - offset << " of " << Fsize << " file bytes\n";
+        return false;
+    }
+    name = Fname;
+    size = Fsize;
+    return true;
+}
+
 int GameClient::handleResponse(const string response) { 
-    char status[32], subStatus[32];
+    char status[32] = "", subStatus[32] = "";
     sscanf(response.c_str(), "%s %s", status, subStatus);
 
+    if (strcmp(subStatus, STATUS_BUSY) == 0) {
+        fprintf(stdout, "Server busy, please try again later.\n");
+        return FAIL;
+    }
+
     if (strcmp(status, RESPONSE_START) == 0) {
         if (strcmp(subStatus, STATUS_OK) == 0) {
             char C1[8], C2[8], C3[8], C4[8];
@@ -184,34 +316,48 @@ int GameClient::handleResponse(const string response) {
             fprintf(stdout, "Failed to start debug game: Invalid request.\n");
             return FAIL;
         }
+    } else if (strcmp(status, RESPONSE_HINT) == 0) {
+        if (strcmp(subStatus, STATUS_OK) == 0) {
+            char C1[8], C2[8], C3[8], C4[8];
+            sscanf(response.c_str(), "%*s %*s %s %s %s %s", C1, C2, C3, C4);
+            fprintf(stdout, "Hint: try %s %s %s %s\n", C1, C2, C3, C4);
+            return SUCCESS;
+        } else if (strcmp(subStatus, STATUS_NOK) == 0) {
+            fprintf(stdout, "No ongoing game for this player.\n");
+            return FAIL;
+        } else if (strcmp(subStatus, STATUS_ERR) == 0) {
+            fprintf(stdout, "Error in hint request.\n");
+            return FAIL;
+        }
+    } else if (strcmp(status, RESPONSE_METRICS) == 0) {
+        if (strcmp(subStatus, STATUS_OK) == 0) {
+            std::string Fname;
+            size_t offset, Fsize;
+            if (!fileReply(response, Fname, offset, Fsize)) return FAIL;
+            fwrite(response.data() + offset, 1, Fsize, stdout);
+            return SUCCESS;
+        } else {
+            fprintf(stdout, "Metrics are only available from the server host.\n");
+            return FAIL;
+        }
     } else if (strcmp(status, RESPONSE_SHOW_TRIALS) == 0) {
         if (strcmp(subStatus, ACCEPT) == 0 || strcmp(subStatus, FINISH) == 0) {
-            char Fname[128], FsizeStr[32];
-            int Fsize;
-            if (sscanf(response.c_str(), "%*s %*s %s %s", Fname, FsizeStr) != 2) {
-                std::cerr << "Error: Malformed response - couldn't parse filename and size\n";
-                return FAIL;
-            }
-            Fsize = atoi(FsizeStr);
-            if (Fsize <= 0) {
+            std::string Fname;
+            size_t offset, Fsize;
+            if (!fileReply(response, Fname, offset, Fsize)) return FAIL;
+            if (Fsize == 0) {
                 std::cerr << "Error: Invalid file size\n";
                 return FAIL;
             }
-            std::string Fdata(response.substr(response.find(FsizeStr) + strlen(FsizeStr) + 1));
-            if (Fdata.empty()) {
-                std::cerr << "Error: No file data found\n";
-                return FAIL;
-            }
-            std::string FnamePath = std::string("Client/Game_History/") + Fname; 
-            std::ofstream outFile(FnamePath);
+            std::ofstream outFile("Client/Game_History/" + Fname);
             if (!outFile) {
                 std::cerr << "Error: Cannot create output file\n";
                 return FAIL;
             }
-            outFile << Fdata;
+            outFile.write(response.data() + offset, Fsize);
             outFile.close();
-            fprintf(stdout, "Received file: %s (%d bytes)\n", Fname, Fsize);
-            fprintf(stdout, "%s", Fdata.c_str());
+            fprintf(stdout, "Received file: %s (%d bytes)\n", Fname.c_str(), static_cast<int>(Fsize));
+            fwrite(response.data() + offset, 1, Fsize, stdout);
             return SUCCESS;
         } else if (strcmp(subStatus, STATUS_NOK) == 0) {
             fprintf(stdout, "No ongoing or finished game for this player.\n");
@@ -222,32 +368,22 @@ int GameClient::handleResponse(const string response) {
         }
     } else if (strcmp(status, RESPONSE_SCOREBOARD) == 0) {
         if (strcmp(subStatus, STATUS_OK) == 0) {
-            char Fname[128], FsizeStr[32];
-            int Fsize;
-            if (sscanf(response.c_str(), "%*s %*s %s %s", Fname, FsizeStr) != 2) {
-                std::cerr << "Error: Malformed response - couldn't parse filename and size\n";
-                return FAIL;
-            }
-            Fsize = atoi(FsizeStr);
-            if (Fsize <= 0) {
+            std::string Fname;
+            size_t offset, Fsize;
+            if (!fileReply(response, Fname, offset, Fsize)) return FAIL;
+            if (Fsize == 0) {
                 std::cerr << "Error: Invalid file size\n";
                 return FAIL;
             }
-            std::string Fdata(response.substr(response.find(FsizeStr) + strlen(FsizeStr) + 1));
-            if (Fdata.empty()) {
-                std::cerr << "Error: No file data found\n";
-                return FAIL;
-            }
-            std::string FnamePath = std::string("Client/Top_Scores/") + Fname;
-            std::ofstream outFile(FnamePath);
+            std::ofstream outFile("Client/Top_Scores/" + Fname);
             if (!outFile) {
                 std::cerr << "Error: Cannot create output file\n";
                 return FAIL;
             }
-            outFile << Fdata;
+            outFile.write(response.data() + offset, Fsize);
             outFile.close();
-            fprintf(stdout, "Received scoreboard file: %s (%d bytes)\n\n", Fname, Fsize);
-            fprintf(stdout, "%s", Fdata.c_str());
+            fprintf(stdout, "Received scoreboard file: %s (%d bytes)\n\n", Fname.c_str(), static_cast<int>(Fsize));
+            fwrite(response.data() + offset, 1, Fsize, stdout);
             return SUCCESS;
         } else if (strcmp(subStatus, "EMPTY") == 0) {
             fprintf(stdout, "Scoreboard is empty.\n");
@@ -256,6 +392,75 @@ int GameClient::handleResponse(const string response) {
             fprintf(stdout, "Unexpected response: %s\n", response.c_str());
             return FAIL;
         }
+    } else if (strcmp(status, RESPONSE_RANK) == 0) {
+        if (strcmp(subStatus, STATUS_OK) == 0) {
+            int rank, total, score;
+            sscanf(response.c_str(), "%*s %*s %d %d %d", &rank, &total, &score);
+            fprintf(stdout, "Rank %d of %d, best score %d.\n", rank, total, score);
+            return SUCCESS;
+        } else if (strcmp(subStatus, STATUS_NOK) == 0) {
+            fprintf(stdout, "No wins for this player on that board.\n");
+            return FAIL;
+        } else {
+            fprintf(stdout, "Error in rank request.\n");
+            return FAIL;
+        }
+    } else if (strcmp(status, RESPONSE_LEADERBOARD) == 0) {
+        if (strcmp(subStatus, STATUS_OK) == 0) {
+            std::string Fname;
+            size_t offset, Fsize;
+            if (!fileReply(response, Fname, offset, Fsize)) return FAIL;
+            std::ofstream outFile("Client/Top_Scores/" + Fname);
+            if (!outFile) {
+                std::cerr << "Error: Cannot create output file\n";
+                return FAIL;
+            }
+            outFile.write(response.data() + offset, Fsize);
+            outFile.close();
+            fprintf(stdout, "Received leaderboard file: %s (%d bytes)\n\n", Fname.c_str(), static_cast<int>(Fsize));
+            fwrite(response.data() + offset, 1, Fsize, stdout);
+            return SUCCESS;
+        } else if (strcmp(subStatus, "EMPTY") == 0) {
+            fprintf(stdout, "No entries in that range.\n");
+            return FAIL;
+        } else {
+            fprintf(stdout, "Error in leaderboard request.\n");
+            return FAIL;
+        }
+    } else if (strcmp(status, RESPONSE_PLAYER_STATS) == 0) {
+        if (strcmp(subStatus, STATUS_OK) == 0) {
+            unsigned games, won, failed, timedOut, quit;
+            int best;
+            double avgTrials, avgSeconds;
+            sscanf(response.c_str(), "%*s %*s %u %u %u %u %u %d %lf %lf", &games, &won, &failed,
+                   &timedOut, &quit, &best, &avgTrials, &avgSeconds);
+            fprintf(stdout, "Games: %u  Won: %u  Failed: %u  Timed out: %u  Quit: %u\n",
+                    games, won, failed, timedOut, quit);
+            fprintf(stdout, "Average trials: %.2f  Average time: %.1f s", avgTrials, avgSeconds);
+            if (best >= 0) fprintf(stdout, "  Best score: %d", best);
+            fprintf(stdout, "\nWins by trials:");
+            std::istringstream wins(response);
+            std::string field;
+            for (int i = 0; i < 10 && wins >> field; i++) {}  // skip to the histogram
+            for (int i = 1; i <= MAX_ATTEMPTS && wins >> field; i++) {
+                fprintf(stdout, " %d:%s", i, field.c_str());
+            }
+            fprintf(stdout, "\n");
+            return SUCCESS;
+        } else if (strcmp(subStatus, STATUS_NOK) == 0) {
+            fprintf(stdout, "No finished games for this player.\n");
+            return FAIL;
+        } else {
+            fprintf(stdout, "Error in stats request.\n");
+            return FAIL;
+        }
+    } else if (strcmp(status, RESPONSE_EXPORT) == 0) {
+        if (strcmp(subStatus, STATUS_NOK) == 0) {
+            fprintf(stdout, "No finished games for this player.\n");
+        } else {
+            fprintf(stdout, "Error in export request.\n");
+        }
+        return FAIL;
     } else {
         fprintf(stdout, "Unexpected response(out of the protocol): %s\n", response.c_str());
         return FAIL;
@@ -271,8 +476,7 @@ void GameClient::handleStartGame(const string& command) {
 
     char sngCommand[128];
     snprintf(sngCommand, sizeof(sngCommand), "SNG %s %d\n", pid, maxPlayTime);
-    sendUDPMessage(udpSocket, sngCommand, (struct sockaddr_in*)udpRes->ai_addr, udpRes->ai_addrlen);
-    std::string response = receiveUDPMessage(udpSocket, (struct sockaddr_in*)udpRes->ai_addr, &udpRes->ai_addrlen);
+    std::string response = exchangeUDP(sngCommand);
     if(handleResponse(response) == SUCCESS) {
         fprintf(stdout, "New game started (max %d sec)\n", maxPlayTime);
         nT = 0;
@@ -286,8 +490,7 @@ void GameClient::handleTry(const string& command) {
 
     char tryCommand[256];
     snprintf(tryCommand, sizeof(tryCommand), "TRY %s %s %d\n", plid.c_str(), colors, ++nT);
-    sendUDPMessage(udpSocket, tryCommand, (struct sockaddr_in*)udpRes->ai_addr, udpRes->ai_addrlen);
-    std::string response = receiveUDPMessage(udpSocket, (struct sockaddr_in*)udpRes->ai_addr, &udpRes->ai_addrlen);
+    std::string response = exchangeUDP(tryCommand);
     if(handleResponse(response) == FAIL)
         nT--;
 }
@@ -299,27 +502,15 @@ void GameClient::handleShowTrials() {
         return;
     }
 
-    setupTCPSocket();
-
     std::string strCommand = "STR " + plid + "\n";
-    sendTCPMessage(tcpSocket, strCommand);
-
-    std::string response = receiveTCPMessage(tcpSocket);
-
+    std::string response = exchangeTCP(strCommand);
     handleResponse(response);
-    closeTCPSocket();
 }
 
 void GameClient::handleScoreboard() {
-    setupTCPSocket();
-
     std::string ssbCommand = "SSB\n";
-    sendTCPMessage(tcpSocket, ssbCommand);
-
-    std::string response = receiveTCPMessage(tcpSocket);
-
+    std::string response = exchangeTCP(ssbCommand);
     handleResponse(response);
-    closeTCPSocket();
 }
 
 void GameClient::handleQuitExit() {
@@ -329,8 +520,7 @@ void GameClient::handleQuitExit() {
     } else {
         qutCommand = "QUT\n";
     }
-    sendUDPMessage(udpSocket, qutCommand, (struct sockaddr_in*)udpRes->ai_addr, udpRes->ai_addrlen);
-    std::string response = receiveUDPMessage(udpSocket, (struct sockaddr_in*)udpRes->ai_addr, &udpRes->ai_addrlen);
+    std::string response = exchangeUDP(qutCommand);
     handleResponse(response);
 }
 
@@ -343,8 +533,7 @@ void GameClient::handleDebug(const std::string& command) {
 
     char dbgCommand[256];
     snprintf(dbgCommand, sizeof(dbgCommand), "DBG %s %d %s %s %s %s\n", pid, maxPlayTime, C1, C2, C3, C4);
-    sendUDPMessage(udpSocket, dbgCommand, (struct sockaddr_in*)udpRes->ai_addr, udpRes->ai_addrlen);
-    std::string response = receiveUDPMessage(udpSocket, (struct sockaddr_in*)udpRes->ai_addr, &udpRes->ai_addrlen);
+    std::string response = exchangeUDP(dbgCommand);
     if(handleResponse(response) == SUCCESS) {
         fprintf(stdout, "New game started (max %d sec) and secret key %s %s %s %s\n", maxPlayTime, C1, C2, C3, C4);
         plid = pid;
@@ -352,6 +541,205 @@ void GameClient::handleDebug(const std::string& command) {
     }
 }
 
+void GameClient::handleHint() {
+    if (plid.empty()) {
+        std::cout << "Player ID not set.\n";
+        return;
+    }
+
+    std::string hntCommand = "HNT " + plid + "\n";
+    std::string response = exchangeUDP(hntCommand);
+    handleResponse(response);
+}
+
+void GameClient::handleMetrics() {
+    std::string mtrCommand = "MTR\n";
+    std::string response = exchangeTCP(mtrCommand);
+    handleResponse(response);
+}
+
+// rank [ALL|PLAY|DEBUG [ALL|DAY|WEEK]]
+void GameClient::handleRank(const std::string& command) {
+    if (plid.empty()) {
+        std::cout << "Player ID not set.\n";
+        return;
+    }
+    char cmd[32], mode[16] = "ALL", window[16] = "ALL";
+    sscanf(command.c_str(), "%31s %15s %15s", cmd, mode, window);
+    std::string response = exchangeTCP("RNK " + plid + " " + mode + " " + window + "\n");
+    handleResponse(response);
+}
+
+// leaderboard first count [ALL|PLAY|DEBUG [ALL|DAY|WEEK]]
+void GameClient::handleLeaderboard(const std::string& command) {
+    char cmd[32], mode[16] = "ALL", window[16] = "ALL";
+    int first, count;
+    if (sscanf(command.c_str(), "%31s %d %d %15s %15s", cmd, &first, &count, mode, window) < 3) {
+        fprintf(stderr, "Error: leaderboard first count [mode [window]]\n");
+        return;
+    }
+    std::string response = exchangeTCP("LDB " + std::to_string(first) + " " + std::to_string(count) +
+                                       " " + mode + " " + window + "\n");
+    handleResponse(response);
+}
+
+// stats [PLID], the player's own by default
+void GameClient::handleStats(const std::string& command) {
+    char cmd[32], id[16] = "";
+    sscanf(command.c_str(), "%31s %15s", cmd, id);
+    std::string target = id[0] != '\0' ? id : plid;
+    if (target.empty()) {
+        std::cout << "Player ID not set.\n";
+        return;
+    }
+    std::string response = exchangeTCP("PST " + target + "\n");
+    handleResponse(response);
+}
+
+// export [PLID]: every finished game of the player, oldest first, written
+// to Client/Game_History as the chunks arrive ("size\n" and size bytes,
+// up to "0\n")
+void GameClient::handleExport(const std::string& command) {
+    char cmd[32], id[16] = "";
+    sscanf(command.c_str(), "%31s %15s", cmd, id);
+    std::string target = id[0] != '\0' ? id : plid;
+    if (target.empty()) {
+        std::cout << "Player ID not set.\n";
+        return;
+    }
+
+    setupTCPSocket();
+    sendTCPMessage(tcpSocket, "EXP " + target + "\n");
+    std::string pending;
+    std::ofstream outFile;
+    std::string Fname;
+    size_t chunk = 0;       // bytes of the current chunk still to come
+    long long total = 0;
+    bool header = true, done = false;
+    char buffer[BUFFER_SIZE];
+    ssize_t received;
+    while (!done && (received = read(tcpSocket, buffer, sizeof(buffer))) != 0) {
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        pending.append(buffer, received);
+        while (!done) {
+            if (chunk > 0) {
+                size_t n = std::min(chunk, pending.size());
+                if (n == 0) break;
+                outFile.write(pending.data(), n);
+                pending.erase(0, n);
+                chunk -= n;
+                total += n;
+                continue;
+            }
+            size_t end = pending.find('\n');
+            if (end == std::string::npos) break;
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if (header) {
+                char status[8], subStatus[8], name[64];
+                if (sscanf(line.c_str(), "%7s %7s %63s", status, subStatus, name) != 3 ||
+                    strcmp(status, RESPONSE_EXPORT) != 0 || strcmp(subStatus, STATUS_OK) != 0) {
+                    closeTCPSocket();
+                    handleResponse(line + "\n");
+                    return;
+                }
+                Fname = name;
+                outFile.open("Client/Game_History/" + Fname);
+                if (!outFile) {
+                    std::cerr << "Error: Cannot create output file\n";
+                    closeTCPSocket();
+                    return;
+                }
+                header = false;
+            } else {
+                chunk = strtoul(line.c_str(), nullptr, 10);
+                done = chunk == 0;
+            }
+        }
+    }
+    closeTCPSocket();
+
+    if (header) {
+        fprintf(stdout, "No response to the export request.\n");
+    } else if (!done) {
+        fprintf(stdout, "Export interrupted, %lld bytes saved in %s.\n", total, Fname.c_str());
+    } else {
+        fprintf(stdout, "Received history file: %s (%lld bytes)\n", Fname.c_str(), total);
+    }
+}
+
+// Sends the requests of a file (one protocol line each, e.g. "TRY 123456 R G B Y 1")
+// packed in as few BAT datagrams as fit the MTU and prints every response
+void GameClient::handleBatch(const std::string& command) {
+    char cmd[32], path[256];
+    sscanf(command.c_str(), "%s %255s", cmd, path);
+
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Cannot open " << path << "\n";
+        return;
+    }
+    std::vector<std::string> requests;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) requests.push_back(line + "\n");
+    }
+
+    std::vector<std::string> batches = packBatches(requests, BATCH_MTU);
+    size_t next = 0;
+    for (size_t b = 0; b < batches.size(); b++) {
+        std::string reply = exchangeUDP(batches[b]);
+        std::vector<std::string> responses = unpackBatchResponse(reply);
+        if (responses.empty()) {
+            std::cout << "Batch " << b + 1 << " failed: " << reply;
+            return;
+        }
+        for (size_t i = 0; i < responses.size(); i++, next++) {
+            std::cout << requests[next].substr(0, requests[next].size() - 1) << " -> " << responses[i];
+        }
+    }
+    std::cout << requests.size() << " requests sent in " << batches.size() << " datagrams.\n";
+}
+
+// Starts a game and plays it with the guesses of the strategy table
+void GameClient::handleAutoplay(const std::string& command) {
+    if (!table.isOpen() && !table.open(strategy::DEFAULT_FILE)) {
+        std::cout << "Autoplay needs a strategy table, build it with ./GSstrategy.\n";
+        return;
+    }
+
+    char cmd[32], pid[32];
+    int maxPlayTime;
+    sscanf(command.c_str(), "%s %s %d", cmd, pid, &maxPlayTime);
+
+    char sngCommand[128];
+    snprintf(sngCommand, sizeof(sngCommand), "SNG %s %d\n", pid, maxPlayTime);
+    if (handleResponse(exchangeUDP(sngCommand)) != SUCCESS) return;
+    fprintf(stdout, "New game started (max %d sec)\n", maxPlayTime);
+    plid = pid;
+    nT = 0;
+
+    int64_t node = 0;
+    while (node >= 0) {
+        std::string colors = table.guess(node);
+        char tryCommand[64];
+        snprintf(tryCommand, sizeof(tryCommand), "TRY %s %s %d\n", plid.c_str(), colors.c_str(), ++nT);
+        fprintf(stdout, "Autoplay: try %s\n", colors.c_str());
+
+        std::string response = exchangeUDP(tryCommand);
+        handleResponse(response);
+        int trial, nB, nW;
+        if (sscanf(response.c_str(), "RTR OK %d %d %d", &trial, &nB, &nW) != 3 || nB == 4) {
+            return;
+        }
+        node = table.next(node, nB, nW);
+    }
+    fprintf(stdout, "Autoplay: feedback not covered by the strategy table.\n");
+}
+
 bool GameClient::checkInputFormat(const std::string& command, int n) {
     const char* ptr = command.c_str();
     int spaces = 0;
@@ -400,6 +788,24 @@ void GameClient::handleCommands() {
         } else if (strncmp(command, "debug", 5) == 0) {
             if (checkInputFormat(command, 7) == false) continue;
             handleDebug(command);
+        } else if (strcmp(command, "hint") == 0) {
+            handleHint();
+        } else if (strcmp(command, "metrics") == 0) {
+            handleMetrics();
+        } else if (strcmp(command, "rank") == 0 || strncmp(command, "rank ", 5) == 0) {
+            handleRank(command);
+        } else if (strncmp(command, "leaderboard ", 12) == 0 || strncmp(command, "lb ", 3) == 0) {
+            handleLeaderboard(command);
+        } else if (strcmp(command, "stats") == 0 || strncmp(command, "stats ", 6) == 0) {
+            handleStats(command);
+        } else if (strcmp(command, "export") == 0 || strncmp(command, "export ", 7) == 0) {
+            handleExport(command);
+        } else if (strncmp(command, "autoplay", 8) == 0) {
+            if (checkInputFormat(command, 3) == false) continue;
+            handleAutoplay(command);
+        } else if (strncmp(command, "batch", 5) == 0) {
+            if (checkInputFormat(command, 2) == false) continue;
+            handleBatch(command);
         } else {
             fprintf(stdout, "Unknown command.\n");
         }
@@ -409,5 +815,6 @@ void GameClient::handleCommands() {
 // Main function
 int main(int argc, char* argv[]) {
     GameClient client(argc, argv);
+    client.run();
     return 0;
 }
\ No newline at end of file
@@ -12,6 +12,9 @@
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <poll.h>
+#include "../utils.hpp"
+#include "../strategy.hpp"
 
 class GameClient {
 private:
@@ -20,15 +23,21 @@ private:
     int udpSocket;
     int tcpSocket;
     int nT;  // Trial number
+    bool binary;    // use the binary protocol (-b)
+    uint16_t seq;   // sequence number of the last binary request
     std::string plid;
     struct addrinfo hints;
     struct addrinfo *udpRes;
     struct addrinfo *tcpRes;
     struct timeval timeout;
+    protocols::RttEstimator rtt; // retransmission timeout of UDP requests
+    strategy::Table table;       // autoplay strategy, opened on first use
 
 public:
     GameClient(int argc, char** argv);
     ~GameClient() = default;
+    // Reads and runs player commands until exit or end of input
+    void run();
 
 private:
     // Initialization/Termination
@@ -40,7 +49,14 @@ private:
     // Communication
     void setupTCPSocket();
     void closeTCPSocket();
+    // Send a request and return the text form of its response. UDP
+    // requests are retransmitted until answered or TIMEOUT_TIME expires
+    std::string exchangeUDP(const std::string& request);
+    bool isReplyTo(const std::string& response, const std::string& request, const std::string& frame);
+    void drainUDPSocket();
+    std::string exchangeTCP(const std::string& request);
     int handleResponse(const std::string response);
+    static bool fileReply(const std::string& response, std::string& name, size_t& offset, size_t& size);
 
     // Command handlers
     void handleStartGame(const std::string& command);
@@ -49,6 +65,14 @@ private:
     void handleScoreboard();
     void handleQuitExit();
     void handleDebug(const std::string& command);
+    void handleHint();
+    void handleMetrics();
+    void handleRank(const std::string& command);
+    void handleLeaderboard(const std::string& command);
+    void handleStats(const std::string& command);
+    void handleExport(const std::string& command);
+    void handleBatch(const std::string& command);
+    void handleAutoplay(const std::string& command);
     bool checkInputFormat(const std::string& command, int n);
     void handleCommands();
 };
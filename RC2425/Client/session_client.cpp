@@ -0,0 +1,252 @@
+#include "session_client.hpp"
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include <poll.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <stdexcept>
+
+using namespace protocols;
+
+SessionClient::SessionClient(const std::string& host, int port, int nSockets, int timeoutMs,
+                             size_t maxInFlight)
+    : timeout(timeoutMs), maxInFlight(maxInFlight > 0 ? maxInFlight : 1), seq(0) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    std::string portStr = std::to_string(port);
+    int errcode = getaddrinfo(host.c_str(), portStr.c_str(), &hints, &res);
+    if (errcode != 0) {
+        throw std::runtime_error(std::string("getaddrinfo error: ") + gai_strerror(errcode));
+    }
+    memcpy(&server, res->ai_addr, sizeof(server));
+    freeaddrinfo(res);
+
+    for (int i = 0; i < (nSockets > 0 ? nSockets : 1); i++) {
+        Socket socket;
+        socket.fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (socket.fd == -1 || fcntl(socket.fd, F_SETFL, O_NONBLOCK) == -1) {
+            // No destructor runs for a constructor that throws
+            if (socket.fd != -1) close(socket.fd);
+            for (size_t j = 0; j < sockets.size(); j++) close(sockets[j].fd);
+            throw std::runtime_error("Error creating UDP socket");
+        }
+        // Room for the replies of a burst of requests
+        int size = 1 << 20;
+        setsockopt(socket.fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        sockets.push_back(socket);
+    }
+}
+
+SessionClient::~SessionClient() {
+    for (size_t i = 0; i < sockets.size(); i++) {
+        close(sockets[i].fd);
+    }
+}
+
+uint64_t SessionClient::key(uint32_t plid, uint16_t seq) {
+    return (static_cast<uint64_t>(plid) << 16) | seq;
+}
+
+void SessionClient::startGame(uint32_t plid, int maxTime, Callback callback) {
+    submit(OP_SNG, plid, maxTime, "", 0, callback);
+}
+
+void SessionClient::tryCode(uint32_t plid, const std::string& colors, int nT, Callback callback) {
+    submit(OP_TRY, plid, 0, colors, nT, callback);
+}
+
+void SessionClient::quitGame(uint32_t plid, Callback callback) {
+    submit(OP_QUT, plid, 0, "", 0, callback);
+}
+
+void SessionClient::debugGame(uint32_t plid, int maxTime, const std::string& colors, Callback callback) {
+    submit(OP_DBG, plid, maxTime, colors, 0, callback);
+}
+
+void SessionClient::hint(uint32_t plid, Callback callback) {
+    submit(OP_HNT, plid, 0, "", 0, callback);
+}
+
+void SessionClient::submit(uint8_t opcode, uint32_t plid, int maxTime, const std::string& colors,
+                           int nT, Callback callback) {
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BINARY_MAGIC;
+    header.version = BINARY_VERSION;
+    header.opcode = opcode;
+    header.plid = htonl(plid);
+    header.seq = htons(++seq);
+    header.time = htons(maxTime);
+    header.code = htons(colors.empty() ? NO_CODE : packCode(colors));
+    header.nT = nT;
+
+    Request request;
+    request.opcode = opcode;
+    request.callback = callback;
+    request.plid = plid;
+    request.seq = seq;
+    request.frame.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (inFlight.size() < maxInFlight && waiting.empty()) {
+        send(request);
+    } else {
+        waiting.push_back(request);
+    }
+}
+
+void SessionClient::send(Request& request) {
+    uint64_t k = key(request.plid, request.seq);
+    request.giveUp = Clock::now() + timeout;
+    request.attempts = 0;
+    request.rto = rtt.timeout();
+    transmit(k, inFlight[k] = request);
+}
+
+void SessionClient::transmit(uint64_t k, Request& request) {
+    request.sentAt = Clock::now();
+    request.deadline = std::min(request.giveUp, request.sentAt + std::chrono::milliseconds(request.rto));
+    request.attempts++;
+    deadlines.push(std::make_pair(request.deadline, k));
+
+    Socket& socket = sockets[request.plid % sockets.size()];
+    socket.outbound.push_back(request.frame);
+    flush(socket);
+}
+
+// Sends held back requests while the window has room
+void SessionClient::admit() {
+    while (!waiting.empty() && inFlight.size() < maxInFlight) {
+        Request request = waiting.front();
+        waiting.pop_front();
+        send(request);
+    }
+}
+
+void SessionClient::flush(Socket& socket) {
+    while (!socket.outbound.empty()) {
+        const std::string& frame = socket.outbound.front();
+        ssize_t n = sendto(socket.fd, frame.data(), frame.size(), 0,
+                           (struct sockaddr*)&server, sizeof(server));
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n == -1) {
+            // The request is left to time out
+            std::cerr << "Error sending message: " << strerror(errno) << "\n";
+        }
+        socket.outbound.pop_front();
+    }
+}
+
+int SessionClient::receive(Socket& socket) {
+    int callbacks = 0;
+    char buffer[BUFFER_SIZE];
+    while (true) {
+        ssize_t n = recv(socket.fd, buffer, sizeof(buffer), 0);
+        if (n == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error receiving message: " << strerror(errno) << "\n";
+            }
+            return callbacks;
+        }
+
+        // Text replies (GS without binary support) cannot be matched
+        std::string frame(buffer, n);
+        BinaryHeader header;
+        if (!decodeBinaryHeader(frame, header)) continue;
+
+        auto it = inFlight.find(key(ntohl(header.plid), ntohs(header.seq)));
+        if (it == inFlight.end()) continue; // late reply to a timed out request
+        if (header.opcode != OP_ERR && header.opcode != (it->second.opcode | 0x80)) continue;
+
+        Request& request = it->second;
+        if (request.attempts == 1) {
+            std::chrono::duration<double, std::milli> elapsed = Clock::now() - request.sentAt;
+            rtt.sample(elapsed.count());
+        }
+        // The GS shed the request: send it again later, backing off
+        if (header.status == BS_BSY && Clock::now() < request.giveUp) {
+            request.rto = std::min(request.rto * 2, static_cast<int>(RttEstimator::RTO_MAX_MS));
+            request.deadline = std::min(request.giveUp, Clock::now() + std::chrono::milliseconds(request.rto));
+            deadlines.push(std::make_pair(request.deadline, it->first));
+            continue;
+        }
+
+        Reply reply;
+        reply.timedOut = false;
+        reply.attempts = request.attempts;
+        reply.opcode = header.opcode;
+        reply.status = header.status;
+        reply.nT = header.nT;
+        reply.nB = header.feedback >> 4;
+        reply.nW = header.feedback & 0xF;
+        reply.colors = unpackCode(ntohs(header.code));
+        reply.text = binaryResponseToText(frame);
+
+        Callback callback = request.callback;
+        inFlight.erase(it);
+        callback(reply);
+        callbacks++;
+    }
+}
+
+int SessionClient::expire() {
+    int callbacks = 0;
+    Clock::time_point now = Clock::now();
+    while (!deadlines.empty() && deadlines.top().first <= now) {
+        Deadline deadline = deadlines.top();
+        deadlines.pop();
+        auto it = inFlight.find(deadline.second);
+        if (it == inFlight.end() || it->second.deadline != deadline.first) continue;
+
+        Request& request = it->second;
+        if (now < request.giveUp) {
+            request.rto = std::min(request.rto * 2, static_cast<int>(RttEstimator::RTO_MAX_MS));
+            transmit(deadline.second, request);
+            continue;
+        }
+
+        Reply reply;
+        reply.timedOut = true;
+        reply.attempts = request.attempts;
+        Callback callback = request.callback;
+        inFlight.erase(it);
+        callback(reply);
+        callbacks++;
+    }
+    return callbacks;
+}
+
+int SessionClient::poll(int timeoutMs) {
+    // Wake up in time for the earliest deadline
+    if (!deadlines.empty()) {
+        auto untilDeadline = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadlines.top().first - Clock::now()).count() + 1;
+        if (untilDeadline < timeoutMs) timeoutMs = untilDeadline < 0 ? 0 : untilDeadline;
+    }
+
+    std::vector<struct pollfd> fds(sockets.size());
+    for (size_t i = 0; i < sockets.size(); i++) {
+        fds[i].fd = sockets[i].fd;
+        fds[i].events = POLLIN | (sockets[i].outbound.empty() ? 0 : POLLOUT);
+        fds[i].revents = 0;
+    }
+    if (::poll(fds.data(), fds.size(), timeoutMs) == -1 && errno != EINTR) {
+        std::cerr << "poll error: " << strerror(errno) << "\n";
+    }
+
+    int callbacks = 0;
+    for (size_t i = 0; i < sockets.size(); i++) {
+        if (fds[i].revents & POLLOUT) flush(sockets[i]);
+        if (fds[i].revents & POLLIN) callbacks += receive(sockets[i]);
+    }
+    callbacks += expire();
+    admit();
+    return callbacks;
+}
+
+void SessionClient::run() {
+    while (pending() > 0) {
+        poll(timeout.count());
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef __H_SESSION_CLIENT
+#define __H_SESSION_CLIENT
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <netinet/in.h>
+#include "../utils.hpp"
+
+// Non-blocking client of the GS for many concurrent player sessions.
+//
+// Requests go out as binary frames over a few non-blocking UDP sockets (a
+// PLID always uses the same socket, so the requests of one player keep
+// their order) and replies are matched back by (PLID, seq) and checked
+// against the opcode of the request. Nothing blocks: requests are queued,
+// and poll() sends what the sockets accept, reads every reply available
+// and runs the callbacks, so one thread can drive thousands of sessions.
+// At most maxInFlight requests wait for a reply at a time, the rest are
+// held back so a burst does not overflow the socket buffers of the GS.
+// Unanswered requests are retransmitted after an RTO estimated from the
+// measured round trips, doubling on every attempt, until timeoutMs.
+class SessionClient {
+public:
+    struct Reply {
+        bool timedOut;       // no reply within the timeout, other fields unset
+        int attempts;        // times the request was sent
+        uint8_t opcode;      // protocols::BinaryOpcode of the reply (OP_ERR on ERR)
+        uint8_t status;      // protocols::BinaryStatus
+        int nT, nB, nW;      // RTR OK
+        std::string colors;  // "R G B Y" of RQT/RHN OK and RTR ENT/ETM, "" otherwise
+        std::string text;    // text form, as the text protocol would have answered
+    };
+    typedef std::function<void(const Reply&)> Callback;
+
+    // Throws std::runtime_error if host does not resolve or the sockets
+    // cannot be created
+    SessionClient(const std::string& host, int port, int nSockets = 1,
+                  int timeoutMs = TIMEOUT_MS, size_t maxInFlight = MAX_IN_FLIGHT);
+    ~SessionClient();
+
+    // Queue a request, the callback runs from poll() when its reply arrives
+    // or when it times out. All of them can be retransmitted safely (a TRY
+    // is resent with the same nT, which the GS answers again)
+    void startGame(uint32_t plid, int maxTime, Callback callback);
+    void tryCode(uint32_t plid, const std::string& colors, int nT, Callback callback);
+    void quitGame(uint32_t plid, Callback callback);
+    void debugGame(uint32_t plid, int maxTime, const std::string& colors, Callback callback);
+    void hint(uint32_t plid, Callback callback);
+
+    // Waits up to timeoutMs for socket activity, sends and receives what it
+    // can and runs the callbacks; returns the number of callbacks run
+    int poll(int timeoutMs);
+    // poll() until every request has been answered or has timed out
+    void run();
+    size_t pending() const { return inFlight.size() + waiting.size(); }
+
+    static const int TIMEOUT_MS = 5000;
+    static const size_t MAX_IN_FLIGHT = 128;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request {
+        uint8_t opcode;
+        Callback callback;
+        Clock::time_point deadline;   // next retransmission
+        Clock::time_point giveUp;
+        Clock::time_point sentAt;     // last transmission
+        int attempts;
+        int rto;                      // ms
+        uint32_t plid;
+        uint16_t seq;
+        std::string frame;
+    };
+    struct Socket {
+        int fd;
+        std::deque<std::string> outbound; // frames not yet accepted by the socket
+    };
+
+    void submit(uint8_t opcode, uint32_t plid, int maxTime, const std::string& colors,
+                int nT, Callback callback);
+    void send(Request& request);
+    void transmit(uint64_t k, Request& request);
+    void admit();
+    void flush(Socket& socket);
+    int receive(Socket& socket);
+    int expire();
+    static uint64_t key(uint32_t plid, uint16_t seq);
+
+    struct sockaddr_in server;
+    std::vector<Socket> sockets;
+    std::unordered_map<uint64_t, Request> inFlight;
+    std::deque<Request> waiting;                                  // over the window
+    typedef std::pair<Clock::time_point, uint64_t> Deadline;
+    // Earliest first; entries of answered or rescheduled requests are skipped
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+    protocols::RttEstimator rtt;
+    std::chrono::milliseconds timeout;
+    size_t maxInFlight;
+    uint16_t seq;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "capture.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace capture {
+
+    uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    bool Writer::open(const std::string& path) {
+        close();
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Cannot create capture file " << path << "\n";
+            return false;
+        }
+        setvbuf(file, nullptr, _IOFBF, 1 << 16);
+        fwrite(MAGIC, 1, sizeof(MAGIC), file);
+        lastFlush = time(nullptr);
+        return true;
+    }
+
+    void Writer::record(uint8_t type, bool isTCP, const struct sockaddr_in* client_addr,
+                        const std::string& payload, uint64_t timestampNs) {
+        if (!file) return;
+
+        RecordHeader header;
+        header.timestampNs = timestampNs ? timestampNs : now();
+        header.type = type;
+        header.isTCP = isTCP ? 1 : 0;
+        header.port = client_addr ? ntohs(client_addr->sin_port) : 0;
+        header.addr = client_addr ? client_addr->sin_addr.s_addr : 0;
+        header.length = payload.size();
+
+        if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+            fwrite(payload.data(), 1, payload.size(), file) != payload.size()) {
+            std::cerr << "Error writing capture file, capture stopped\n";
+            close();
+            return;
+        }
+
+        time_t second = time(nullptr);
+        if (second != lastFlush) {
+            fflush(file);
+            lastFlush = second;
+        }
+    }
+
+    void Writer::flush() {
+        if (file) {
+            fflush(file);
+            lastFlush = time(nullptr);
+        }
+    }
+
+    void Writer::close() {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    Reader::~Reader() {
+        if (file) fclose(file);
+    }
+
+    bool Reader::open(const std::string& path) {
+        file = fopen(path.c_str(), "rb");
+        if (!file) {
+            std::cerr << "Cannot open capture file " << path << "\n";
+            return false;
+        }
+        char magic[sizeof(MAGIC)];
+        if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+            memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            std::cerr << "Not a GS capture file: " << path << "\n";
+            fclose(file);
+            file = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    bool Reader::next(RecordHeader& header, std::string& payload) {
+        if (!file || fread(&header, sizeof(header), 1, file) != 1) {
+            return false;
+        }
+        payload.resize(header.length);
+        if (header.length > 0 && fread(&payload[0], 1, header.length, file) != header.length) {
+            return false;
+        }
+        return true;
+    }
+}
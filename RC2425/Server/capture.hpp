@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <netinet/in.h>
+
+// Binary traffic capture of the GS (written with "GS -c file", read back
+// by GSreplay).
+//
+// File layout (host byte order): the 8 byte MAGIC followed by records, each
+// a RecordHeader and `length` payload bytes. Every request record is
+// followed by the record of the response the GS sent to it. A queued UDP
+// request is recorded when the GS takes it from the queue, with the time
+// it was received, so the request timestamps are not always in file order.
+namespace capture {
+
+    const char MAGIC[8] = {'G', 'S', 'C', 'A', 'P', '1', '\0', '\0'};
+
+    const uint8_t REQUEST = 'Q';
+    const uint8_t RESPONSE = 'R';
+
+    struct __attribute__((packed)) RecordHeader {
+        uint64_t timestampNs; // CLOCK_REALTIME
+        uint8_t type;         // REQUEST or RESPONSE
+        uint8_t isTCP;
+        uint16_t port;        // client port (host order)
+        uint32_t addr;        // client IPv4 address (network order)
+        uint32_t length;      // payload bytes
+    };
+
+    // CLOCK_REALTIME in nanoseconds, the time of the records
+    uint64_t now();
+
+    class Writer {
+    public:
+        Writer() : file(nullptr), lastFlush(0) {}
+        ~Writer() { close(); }
+
+        bool open(const std::string& path);
+        bool isOpen() const { return file != nullptr; }
+        // timestampNs 0 for the current time
+        void record(uint8_t type, bool isTCP, const struct sockaddr_in* client_addr,
+                    const std::string& payload, uint64_t timestampNs = 0);
+        void flush();
+        void close();
+
+    private:
+        FILE* file;
+        time_t lastFlush; // buffered records reach the disk at least once a second
+    };
+
+    class Reader {
+    public:
+        Reader() : file(nullptr) {}
+        ~Reader();
+
+        bool open(const std::string& path);
+        // Next record, false at end of file or on a truncated record
+        bool next(RecordHeader& header, std::string& payload);
+
+    private:
+        FILE* file;
+    };
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <ctime>
+
+class Game;
+
+// Observer of the state changes of the games, registered with
+// Game::addListener. Each call is made right after the change has been
+// written to the game files, from the thread running the GS.
+class GameListener {
+public:
+    virtual ~GameListener() {}
+
+    virtual void onGameCreated(const Game& game) {}
+    // trial as "R G B Y", played at now
+    virtual void onTrialAppended(const Game& game, const std::string& trial,
+                                 int nB, int nW, time_t now) {}
+    // endCode: W (win), F (no trials left), Q (quit) or T (timeout)
+    virtual void onGameFinalized(const Game& game, char endCode, time_t now) {}
+    virtual void onScoreRecorded(const Game& game, int score, time_t now) {}
+};
@@ -0,0 +1,293 @@
+#include "logger.hpp"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <arpa/inet.h>
+
+namespace logger {
+
+    namespace {
+        enum Kind : uint8_t { NEW_GAME, TRIAL, SUSPICIOUS, REQUEST, RESPONSE };
+
+        const size_t CAPACITY = 4096; // power of two
+        const size_t TEXT_SIZE = 96;
+
+        struct Record {
+            uint8_t kind;
+            uint8_t isTCP;
+            char flag;          // game mode or trial outcome
+            uint16_t port;
+            uint32_t addr;      // network order, 0 when unknown
+            int32_t values[3];
+            char plid[7];
+            char command[10];
+            char text[TEXT_SIZE];
+        };
+
+        struct Slot {
+            std::atomic<size_t> sequence;
+            Record record;
+        };
+
+        std::unique_ptr<Slot[]> ring;
+        std::atomic<size_t> tail(0);   // next position to write
+        size_t head = 0;               // next position to read, writer thread only
+
+        std::atomic<bool> running(false);
+        std::thread writer;
+
+        // The writer sleeps on wake while the ring is empty; the producer
+        // that finds it asleep wakes it, the others only read the flag
+        std::atomic<bool> sleeping(false);
+        std::mutex wakeMutex;
+        std::condition_variable wake;
+
+        void wakeWriter() {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                sleeping.store(false, std::memory_order_relaxed);
+            }
+            wake.notify_one();
+        }
+
+        unsigned sampleEvery = 1;
+        unsigned maxPerSecond = 0;
+        std::atomic<uint64_t> sampleCounter(0);
+        std::atomic<time_t> rateWindow(0);
+        std::atomic<unsigned> rateCount(0);
+        std::atomic<uint64_t> droppedCount(0);
+
+        void copyText(char* dest, size_t size, const std::string& src) {
+            size_t n = std::min(size - 1, src.size());
+            memcpy(dest, src.data(), n);
+            dest[n] = '\0';
+        }
+
+        // Like copyText, but a truncated line still ends with a newline
+        void copyLine(char* dest, size_t size, const std::string& src) {
+            copyText(dest, size, src);
+            if (src.size() >= size) {
+                memcpy(dest + size - 5, "...\n", 5);
+            }
+        }
+
+        bool allowed() {
+            if (maxPerSecond == 0) return true;
+            time_t now = time(nullptr);
+            time_t window = rateWindow.load(std::memory_order_relaxed);
+            if (window != now && rateWindow.compare_exchange_strong(window, now)) {
+                rateCount.store(0, std::memory_order_relaxed);
+            }
+            return rateCount.fetch_add(1, std::memory_order_relaxed) < maxPerSecond;
+        }
+
+        // Bounded MPMC queue (Vyukov): a slot is free for position pos when
+        // its sequence equals pos and readable when it equals pos + 1
+        void push(const Record& record) {
+            if (!running.load(std::memory_order_relaxed)) return;
+            if (!allowed()) {
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            size_t pos = tail.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &ring[pos & (CAPACITY - 1)];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    droppedCount.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                } else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+            slot->record = record;
+            slot->sequence.store(pos + 1, std::memory_order_release);
+            // Pairs with the fence of writerLoop: either it sees the record
+            // or this sees it asleep
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping.load(std::memory_order_relaxed)) wakeWriter();
+        }
+
+        bool readable() {
+            return ring[head & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == head + 1;
+        }
+
+        bool pop(Record& record) {
+            Slot& slot = ring[head & (CAPACITY - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) return false;
+            record = slot.record;
+            slot.sequence.store(head + CAPACITY, std::memory_order_release);
+            head++;
+            return true;
+        }
+
+        std::string clientInfo(const Record& r) {
+            char ipstr[INET_ADDRSTRLEN];
+            struct in_addr addr;
+            addr.s_addr = r.addr;
+            inet_ntop(AF_INET, &addr, ipstr, INET_ADDRSTRLEN);
+            return std::string(ipstr) + ":" + std::to_string(r.port);
+        }
+
+        void format(const Record& r, std::string& out) {
+            char line[256];
+            switch (r.kind) {
+            case NEW_GAME:
+                snprintf(line, sizeof(line), "PLID: %s: new %sgame (max %d sec); Colors: %s\n",
+                         r.plid, r.flag == 'D' ? "debug " : "", r.values[0], r.text);
+                out += line;
+                break;
+            case TRIAL:
+                snprintf(line, sizeof(line), "PLID: %s:try %s nB: %d nW: %d %s; candidates: %d\n",
+                         r.plid, r.text, r.values[0], r.values[1],
+                         r.flag == 'W' ? "Win (game ended)" : "not guessed", r.values[2]);
+                out += line;
+                break;
+            case SUSPICIOUS:
+                snprintf(line, sizeof(line), "PLID: %s: suspicious solve at trial %d with %d candidates left\n",
+                         r.plid, r.values[0], r.values[1]);
+                out += line;
+                break;
+            case REQUEST:
+                out += "Request from client: " + std::string(r.command) + " ";
+                if (r.addr != 0) out += clientInfo(r) + "\n";
+                out += std::string("    Protocol: ") + (r.isTCP ? "TCP" : "UDP") + "\n";
+                out += "    Command: " + std::string(r.command);
+                if (r.plid[0] != '\0') out += "\n    PLID: " + std::string(r.plid);
+                out += "\n    Full request: " + std::string(r.text);
+                break;
+            case RESPONSE:
+                out += "\nResponse to client:";
+                if (r.addr != 0) out += " " + clientInfo(r);
+                out += std::string("\n    Protocol: ") + (r.isTCP ? "TCP" : "UDP") + "\n";
+                out += "    Response: " + std::string(r.text) + "\n";
+                break;
+            }
+        }
+
+        void writerLoop() {
+            std::string batch;
+            Record record;
+            while (true) {
+                bool stopping = !running.load(std::memory_order_acquire);
+                while (batch.size() < (1 << 16) && pop(record)) {
+                    format(record, batch);
+                }
+                if (!batch.empty()) {
+                    fwrite(batch.data(), 1, batch.size(), stdout);
+                    fflush(stdout);
+                    batch.clear();
+                    continue;
+                }
+                if (stopping) return;
+
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!readable() && running.load(std::memory_order_acquire)) {
+                    wake.wait(lock, []() { return !sleeping.load(std::memory_order_relaxed); });
+                }
+                sleeping.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        Record makeRecord(Kind kind, const std::string& plid) {
+            Record r;
+            memset(&r, 0, offsetof(Record, text));
+            r.kind = kind;
+            r.text[0] = '\0';
+            copyText(r.plid, sizeof(r.plid), plid);
+            return r;
+        }
+    }
+
+    void start(unsigned sample, unsigned perSecond) {
+        if (running.load()) return;
+        sampleEvery = sample == 0 ? 1 : sample;
+        maxPerSecond = perSecond;
+        ring.reset(new Slot[CAPACITY]);
+        for (size_t i = 0; i < CAPACITY; i++) {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        tail.store(0);
+        head = 0;
+        running.store(true, std::memory_order_release);
+        writer = std::thread(writerLoop);
+    }
+
+    void stop() {
+        if (!running.exchange(false)) return;
+        wakeWriter();
+        writer.join();
+    }
+
+    bool sampleRequest() {
+        return sampleEvery == 1 ||
+               sampleCounter.fetch_add(1, std::memory_order_relaxed) % sampleEvery == 0;
+    }
+
+    void newGame(const std::string& plid, int maxTime, const std::string& colors, char mode) {
+        Record r = makeRecord(NEW_GAME, plid);
+        r.flag = mode;
+        r.values[0] = maxTime;
+        copyText(r.text, TEXT_SIZE, colors);
+        push(r);
+    }
+
+    void trial(const std::string& plid, const std::string& colors, int nB, int nW,
+               int candidates, char outcome) {
+        Record r = makeRecord(TRIAL, plid);
+        r.flag = outcome;
+        r.values[0] = nB;
+        r.values[1] = nW;
+        r.values[2] = candidates;
+        copyText(r.text, TEXT_SIZE, colors);
+        push(r);
+    }
+
+    void suspiciousSolve(const std::string& plid, int trialNum, int candidates) {
+        Record r = makeRecord(SUSPICIOUS, plid);
+        r.values[0] = trialNum;
+        r.values[1] = candidates;
+        push(r);
+    }
+
+    void request(const struct sockaddr_in* client_addr, bool isTCP,
+                 const char* command, const char* plid, const std::string& request) {
+        Record r = makeRecord(REQUEST, plid);
+        r.isTCP = isTCP;
+        if (client_addr != nullptr) {
+            r.addr = client_addr->sin_addr.s_addr;
+            r.port = ntohs(client_addr->sin_port);
+        }
+        copyText(r.command, sizeof(r.command), command);
+        copyLine(r.text, TEXT_SIZE, request);
+        push(r);
+    }
+
+    void response(const struct sockaddr_in* client_addr, bool isTCP, const std::string& response) {
+        Record r = makeRecord(RESPONSE, "");
+        r.isTCP = isTCP;
+        if (client_addr != nullptr) {
+            r.addr = client_addr->sin_addr.s_addr;
+            r.port = ntohs(client_addr->sin_port);
+        }
+        copyLine(r.text, TEXT_SIZE, response);
+        push(r);
+    }
+
+    uint64_t dropped() {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+}
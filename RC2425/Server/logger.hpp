@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <netinet/in.h>
+
+// Asynchronous logger of the GS.
+//
+// Request threads only copy a fixed size record into a lock-free bounded
+// ring (one compare-and-swap per record) and a background thread formats
+// and writes them to stdout in batches. When the ring is full, or the rate
+// limit is reached, records are dropped and counted instead of blocking
+// the request path. Verbose request/response dumps can also be sampled.
+namespace logger {
+
+    // sampleEvery: log 1 of every N verbose requests (1 logs all)
+    // maxPerSecond: records accepted per second, 0 for no limit
+    void start(unsigned sampleEvery, unsigned maxPerSecond);
+    // Drains the ring and stops the writer thread
+    void stop();
+
+    // Decides whether the verbose dump of the current request is logged
+    bool sampleRequest();
+
+    void newGame(const std::string& plid, int maxTime, const std::string& colors, char mode);
+    // outcome: 'R' resent trial, 'W' win
+    void trial(const std::string& plid, const std::string& colors, int nB, int nW,
+               int candidates, char outcome);
+    void suspiciousSolve(const std::string& plid, int trialNum, int candidates);
+    void request(const struct sockaddr_in* client_addr, bool isTCP,
+                 const char* command, const char* plid, const std::string& request);
+    void response(const struct sockaddr_in* client_addr, bool isTCP, const std::string& response);
+
+    // Records dropped because the ring was full or over the rate limit
+    uint64_t dropped();
+}
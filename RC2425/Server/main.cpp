@@ -0,0 +1,134 @@
+#include "server.hpp"
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include "logger.hpp"
+
+int main(int argc, char* argv[]) {
+    int port = DSPORT_DEFAULT;
+    bool verbose = false;
+    std::string captureFile, dataDir, standbyAddr;
+    std::string upgradePath, handoffPath;
+    int replicaPort = 0, sessionBudget = 0;
+    unsigned logSample = 1, logRate = 0;
+    
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[i + 1]);
+            i++; 
+        }
+        else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            logSample = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            logRate = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            captureFile = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dataDir = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            standbyAddr = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            replicaPort = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-U") == 0 && i + 1 < argc) {
+            upgradePath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            handoffPath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            sessionBudget = atoi(argv[i + 1]);
+            i++;
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [-p GSport] [-v] [-s N] [-r N] [-c capturefile] [-d datadir]"
+                      << " [-R standbyhost:port | -S replicationport] [-U upgradesocket] [-H upgradesocket]"
+                      << " [-m sessions]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Validate port number
+    if (port <= 0 || port > 65535) {
+        std::cerr << "Invalid port number. Using default port " << DSPORT_DEFAULT << std::endl;
+        port = DSPORT_DEFAULT;
+    }
+
+    // Standby to replicate to, as host:port
+    struct sockaddr_in replica;
+    if (!standbyAddr.empty()) {
+        size_t colon = standbyAddr.rfind(':');
+        struct addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (colon == std::string::npos ||
+            getaddrinfo(standbyAddr.substr(0, colon).c_str(), standbyAddr.substr(colon + 1).c_str(),
+                        &hints, &res) != 0) {
+            std::cerr << "Invalid standby address " << standbyAddr << std::endl;
+            return 1;
+        }
+        memcpy(&replica, res->ai_addr, sizeof(replica));
+        freeaddrinfo(res);
+    }
+
+    // Games and scores live under datadir/Server, so several servers can
+    // run side by side (behind GSproxy) without sharing files
+    if (!dataDir.empty()) {
+        if ((mkdir(dataDir.c_str(), 0777) == -1 && errno != EEXIST) ||
+            chdir(dataDir.c_str()) == -1 ||
+            (mkdir("Server", 0777) == -1 && errno != EEXIST)) {
+            perror(("Cannot use data directory " + dataDir).c_str());
+            return 1;
+        }
+    }
+
+    logger::start(logSample, logRate);
+    try {
+        // An upgrade takes the sockets and games of the running GS instead
+        // of binding the port
+        std::unique_ptr<Server> server(handoffPath.empty() ? new Server(port, verbose)
+                                                           : new Server(verbose));
+        server->setSessionBudget(sessionBudget > 0 ? sessionBudget : 0);
+        if (!handoffPath.empty() && !server->takeOver(handoffPath)) {
+            return 1;
+        }
+        if (!upgradePath.empty() && !server->acceptUpgrades(upgradePath)) {
+            return 1;
+        }
+        if (!captureFile.empty() && !server->startCapture(captureFile)) {
+            return 1;
+        }
+        if (replicaPort > 0 && !server->startStandby(replicaPort)) {
+            return 1;
+        }
+        if (!standbyAddr.empty()) {
+            server->startReplication(replica);
+        }
+        server->run();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        logger::stop();
+        return 1;
+    }
+    logger::stop();
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "metrics.hpp"
+#include <vector>
+#include <mutex>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+namespace metrics {
+
+    namespace {
+        const char* COMMAND_NAMES[NUM_COMMANDS] = {
+            "SNG", "TRY", "QUT", "DBG", "STR", "SSB", "HNT", "MTR", "BAT", "PRM", "RNK", "LDB", "PST",
+            "EXP", "OTHER"
+        };
+        const char* RESULT_NAMES[NUM_RESULTS] = {
+            "OK", "NOK", "ERR", "DUP", "INV", "ENT", "ETM", "ACT", "FIN", "EMPTY", "BSY", "OTHER"
+        };
+        const char* STAGE_NAMES[NUM_STAGES] = {"parse", "handle", "persist"};
+        const char* COUNTER_NAMES[NUM_COUNTERS] = {
+            "cached_replies", "replicated_changes", "session_hits", "session_restores",
+            "session_evictions", "shed_requests", "replication_gaps"
+        };
+
+        std::mutex registryMutex;
+        std::vector<ThreadMetrics*> registry;
+
+        // Owner-only increment: the slot has a single writer, so a relaxed
+        // load and store are enough and readers never see torn values
+        inline void bump(std::atomic<uint64_t>& counter, uint64_t by = 1) {
+            counter.store(counter.load(std::memory_order_relaxed) + by,
+                          std::memory_order_relaxed);
+        }
+
+        ThreadMetrics* createSlot() {
+            // Plain new does not honour alignas(64) before C++17
+            void* memory = nullptr;
+            if (posix_memalign(&memory, 64, sizeof(ThreadMetrics)) != 0) {
+                throw std::bad_alloc();
+            }
+            ThreadMetrics* slot = new (memory) ThreadMetrics();
+            std::lock_guard<std::mutex> lock(registryMutex);
+            registry.push_back(slot);
+            return slot;
+        }
+    }
+
+    int Histogram::bucketIndex(uint64_t nanos) {
+        if (nanos < 4) return static_cast<int>(nanos);
+        int msb = 63 - __builtin_clzll(nanos);
+        int sub = static_cast<int>((nanos >> (msb - 2)) & 3);
+        int index = 4 * (msb - 1) + sub;
+        return index < NUM_BUCKETS ? index : NUM_BUCKETS - 1;
+    }
+
+    uint64_t Histogram::bucketLowerBound(int index) {
+        if (index < 4) return index;
+        int msb = index / 4 + 1;
+        return static_cast<uint64_t>(4 + index % 4) << (msb - 2);
+    }
+
+    void Histogram::record(uint64_t nanos) {
+        bump(buckets[bucketIndex(nanos)]);
+        bump(sum, nanos);
+    }
+
+    ThreadMetrics& local() {
+        static thread_local ThreadMetrics* slot = createSlot();
+        return *slot;
+    }
+
+    Command commandIndex(const char* command) {
+        for (int i = 0; i < CMD_OTHER; i++) {
+            if (strcmp(command, COMMAND_NAMES[i]) == 0) return static_cast<Command>(i);
+        }
+        return CMD_OTHER;
+    }
+
+    Result resultIndex(const std::string& response) {
+        size_t begin = response.find(' ');
+        if (begin == std::string::npos) {
+            // Bare "ERR\n" for unknown requests
+            return response.compare(0, 3, "ERR") == 0 ? RES_ERR : RES_OTHER;
+        }
+        begin++;
+        size_t end = response.find_first_of(" \n", begin);
+        std::string status = response.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        for (int i = 0; i < RES_OTHER; i++) {
+            if (status == RESULT_NAMES[i]) return static_cast<Result>(i);
+        }
+        return RES_OTHER;
+    }
+
+    void recordRequest(Command command, const std::string& response,
+                       size_t bytesIn, size_t bytesOut) {
+        ThreadMetrics& m = local();
+        bump(m.requests[command][resultIndex(response)]);
+        bump(m.bytesIn, bytesIn);
+        bump(m.bytesOut, bytesOut);
+    }
+
+    void recordLatency(Stage stage, uint64_t nanos) {
+        local().latency[stage].record(nanos);
+    }
+
+    void count(Counter counter, uint64_t n) {
+        bump(local().counters[counter], n);
+    }
+
+    void StageTimer::stop() {
+        if (stopped) return;
+        stopped = true;
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        recordLatency(stage, elapsed.count());
+    }
+
+    std::string report(size_t activeGames) {
+        uint64_t requests[NUM_COMMANDS][NUM_RESULTS] = {{0}};
+        uint64_t buckets[NUM_STAGES][NUM_BUCKETS] = {{0}};
+        uint64_t sums[NUM_STAGES] = {0};
+        uint64_t bytesIn = 0, bytesOut = 0;
+        uint64_t counters[NUM_COUNTERS] = {0};
+
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (size_t t = 0; t < registry.size(); t++) {
+                const ThreadMetrics& m = *registry[t];
+                for (int c = 0; c < NUM_COMMANDS; c++) {
+                    for (int r = 0; r < NUM_RESULTS; r++) {
+                        requests[c][r] += m.requests[c][r].load(std::memory_order_relaxed);
+                    }
+                }
+                bytesIn += m.bytesIn.load(std::memory_order_relaxed);
+                bytesOut += m.bytesOut.load(std::memory_order_relaxed);
+                for (int c = 0; c < NUM_COUNTERS; c++) {
+                    counters[c] += m.counters[c].load(std::memory_order_relaxed);
+                }
+                for (int s = 0; s < NUM_STAGES; s++) {
+                    const Histogram& h = m.latency[s];
+                    for (int b = 0; b < NUM_BUCKETS; b++) {
+                        buckets[s][b] += h.buckets[b].load(std::memory_order_relaxed);
+                    }
+                    sums[s] += h.sum.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::stringstream ss;
+        for (int c = 0; c < NUM_COMMANDS; c++) {
+            for (int r = 0; r < NUM_RESULTS; r++) {
+                if (requests[c][r] == 0) continue;
+                ss << "gs_requests_total{command=\"" << COMMAND_NAMES[c]
+                   << "\",result=\"" << RESULT_NAMES[r] << "\"} " << requests[c][r] << "\n";
+            }
+        }
+        ss << "gs_active_games " << activeGames << "\n";
+        ss << "gs_bytes_in_total " << bytesIn << "\n";
+        ss << "gs_bytes_out_total " << bytesOut << "\n";
+        for (int c = 0; c < NUM_COUNTERS; c++) {
+            ss << "gs_" << COUNTER_NAMES[c] << "_total " << counters[c] << "\n";
+        }
+        // Share of the game lookups answered without reading a game file
+        uint64_t lookups = counters[CNT_SESSION_HITS] + counters[CNT_SESSION_RESTORES];
+        ss << "gs_session_hit_ratio "
+           << (lookups ? (double)counters[CNT_SESSION_HITS] / lookups : 1.0) << "\n";
+
+        // Cumulative buckets, only over the range that holds samples. le is
+        // the largest value of the bucket (the next lower bound minus one);
+        // the last bucket, unbounded, is only counted in le="+Inf", which
+        // closes every stage, and the count is the same bucket total.
+        for (int s = 0; s < NUM_STAGES; s++) {
+            int first = NUM_BUCKETS, last = -1;
+            for (int b = 0; b < NUM_BUCKETS - 1; b++) {
+                if (buckets[s][b] == 0) continue;
+                if (first == NUM_BUCKETS) first = b;
+                last = b;
+            }
+            uint64_t cumulative = 0;
+            for (int b = first; b <= last; b++) {
+                cumulative += buckets[s][b];
+                ss << "gs_latency_ns_bucket{stage=\"" << STAGE_NAMES[s]
+                   << "\",le=\"" << Histogram::bucketLowerBound(b + 1) - 1 << "\"} "
+                   << cumulative << "\n";
+            }
+            uint64_t total = 0;
+            for (int b = 0; b < NUM_BUCKETS; b++) total += buckets[s][b];
+            ss << "gs_latency_ns_bucket{stage=\"" << STAGE_NAMES[s] << "\",le=\"+Inf\"} " << total << "\n";
+            ss << "gs_latency_ns_count{stage=\"" << STAGE_NAMES[s] << "\"} " << total << "\n";
+            ss << "gs_latency_ns_sum{stage=\"" << STAGE_NAMES[s] << "\"} " << sums[s] << "\n";
+        }
+        return ss.str();
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Request counters and latency histograms for the GS.
+//
+// Every thread that records writes only to its own cache line aligned slot
+// (plain relaxed load + store, no read-modify-write), and report() sums the
+// slots of all threads. Latencies go to log-linear histograms: four linear
+// sub-buckets per power of two of nanoseconds.
+namespace metrics {
+
+    enum Command {
+        CMD_SNG, CMD_TRY, CMD_QUT, CMD_DBG, CMD_STR, CMD_SSB,
+        CMD_HNT, CMD_MTR, CMD_BAT, CMD_PRM, CMD_RNK, CMD_LDB, CMD_PST, CMD_EXP,
+        CMD_OTHER, NUM_COMMANDS
+    };
+
+    enum Result {
+        RES_OK, RES_NOK, RES_ERR, RES_DUP, RES_INV, RES_ENT, RES_ETM,
+        RES_ACT, RES_FIN, RES_EMPTY, RES_BSY, RES_OTHER, NUM_RESULTS
+    };
+
+    enum Stage {
+        STAGE_PARSE,    // command recognition in Server::handleRequest
+        STAGE_HANDLE,   // request handler
+        STAGE_PERSIST,  // game and score file writes
+        NUM_STAGES
+    };
+
+    // Event counters, reported as gs_<name>_total
+    enum Counter {
+        CNT_CACHED_REPLIES,     // UDP retransmissions answered from the reply cache
+        CNT_REPLICATED_CHANGES, // game changes applied by a standby
+        CNT_SESSION_HITS,       // games found in memory
+        CNT_SESSION_RESTORES,   // evicted games restored from their game files
+        CNT_SESSION_EVICTIONS,  // games dropped from memory over the session budget
+        CNT_SHED_REQUESTS,      // requests answered BSY without being handled
+        CNT_REPLICATION_GAPS,   // changes a standby could not apply (missed earlier ones)
+        NUM_COUNTERS
+    };
+
+    const int NUM_BUCKETS = 160; // up to 2^40 ns
+
+    class Histogram {
+    public:
+        void record(uint64_t nanos);
+        static int bucketIndex(uint64_t nanos);
+        static uint64_t bucketLowerBound(int index);
+
+        std::atomic<uint64_t> buckets[NUM_BUCKETS];  // their total is the count
+        std::atomic<uint64_t> sum;
+    };
+
+    struct alignas(64) ThreadMetrics {
+        std::atomic<uint64_t> requests[NUM_COMMANDS][NUM_RESULTS];
+        std::atomic<uint64_t> bytesIn;
+        std::atomic<uint64_t> bytesOut;
+        std::atomic<uint64_t> counters[NUM_COUNTERS];
+        Histogram latency[NUM_STAGES];
+    };
+
+    // Calling thread's slot, registered on first use
+    ThreadMetrics& local();
+
+    Command commandIndex(const char* command);
+    // Result from the status token of a response ("RTR OK 1 0 0" -> RES_OK)
+    Result resultIndex(const std::string& response);
+
+    void recordRequest(Command command, const std::string& response,
+                       size_t bytesIn, size_t bytesOut);
+    void recordLatency(Stage stage, uint64_t nanos);
+    void count(Counter counter, uint64_t n = 1);
+
+    // Text exposition of all counters, one "name{labels} value" per line
+    std::string report(size_t activeGames);
+
+    // Records the time between construction and destruction in a stage
+    class StageTimer {
+    public:
+        explicit StageTimer(Stage s) : stage(s), start(std::chrono::steady_clock::now()) {}
+        ~StageTimer() { stop(); }
+        void stop();
+
+    private:
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+        bool stopped = false;
+    };
+}
@@ -0,0 +1,156 @@
+#include "ranking.hpp"
+#include "server.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <dirent.h>
+
+namespace ranking {
+
+    const char* MODE_NAMES[NUM_MODES] = {"ALL", "PLAY", "DEBUG"};
+    const char* WINDOW_NAMES[NUM_WINDOWS] = {"ALL", "DAY", "WEEK"};
+
+    int modeIndex(const std::string& name) {
+        for (int i = 0; i < NUM_MODES; i++) {
+            if (name == MODE_NAMES[i]) return i;
+        }
+        return -1;
+    }
+
+    int windowIndex(const std::string& name) {
+        for (int i = 0; i < NUM_WINDOWS; i++) {
+            if (name == WINDOW_NAMES[i]) return i;
+        }
+        return -1;
+    }
+
+    void Board::insert(const Entry& entry, int64_t now) {
+        if (window > 0 && now - entry.time >= window) return;
+        tree.insert(entry);
+        players[entry.plid].insert(entry);
+        if (window > 0) oldest.push(entry);
+    }
+
+    void Board::erase(const Entry& entry) {
+        tree.erase(entry);
+        auto it = players.find(entry.plid);
+        it->second.erase(entry);
+        if (it->second.empty()) players.erase(it);
+    }
+
+    void Board::expire(int64_t now) {
+        while (window > 0 && !oldest.empty() && now - oldest.top().time >= window) {
+            erase(oldest.top());
+            oldest.pop();
+        }
+    }
+
+    const Entry* Board::best(uint32_t plid) const {
+        auto it = players.find(plid);
+        return it == players.end() ? nullptr : &*it->second.begin();
+    }
+
+    std::vector<Entry> Board::range(size_t first, size_t count) const {
+        std::vector<Entry> entries;
+        if (first == 0 || first > tree.size()) return entries;
+        for (Tree::const_iterator it = tree.find_by_order(first - 1);
+             it != tree.end() && entries.size() < count; ++it) {
+            entries.push_back(*it);
+        }
+        return entries;
+    }
+
+    Index::Index() : nextId(0) {
+        for (int m = 0; m < NUM_MODES; m++) {
+            for (int w = 0; w < NUM_WINDOWS; w++) boards[m][w].setWindow(WINDOW_SECONDS[w]);
+        }
+    }
+
+    void Index::load(const std::string& dir) {
+        struct dirent** files;
+        int n = scandir(dir.c_str(), &files, nullptr, nullptr);
+        if (n < 0) return;
+
+        // Score files: SSS_PLID_DDMMYYYY_HHMMSS.txt holding "SSS PLID C C C C N MODE"
+        for (int i = 0; i < n; i++) {
+            const char* name = files[i]->d_name;
+            struct tm when;
+            memset(&when, 0, sizeof(when));
+            int score;
+            unsigned plid;
+            if (sscanf(name, "%d_%u_%2d%2d%4d_%2d%2d%2d", &score, &plid, &when.tm_mday, &when.tm_mon,
+                       &when.tm_year, &when.tm_hour, &when.tm_min, &when.tm_sec) == 8) {
+                when.tm_mon -= 1;
+                when.tm_year -= 1900;
+                FILE* fp = fopen((dir + name).c_str(), "r");
+                char c1, c2, c3, c4, mode[8];
+                int trials;
+                if (fp && fscanf(fp, "%*d %*s %c %c %c %c %d %7s", &c1, &c2, &c3, &c4,
+                                 &trials, mode) == 6) {
+                    std::string colors = std::string(1, c1) + " " + c2 + " " + c3 + " " + c4;
+                    add(score, plid, colors, trials, strcmp(mode, "DEBUG") == 0 ? 'D' : 'P',
+                        timegm(&when));
+                }
+                if (fp) fclose(fp);
+            }
+            free(files[i]);
+        }
+        free(files);
+    }
+
+    void Index::add(int score, uint32_t plid, const std::string& colors, int trials,
+                    char mode, int64_t time) {
+        Entry entry;
+        entry.score = score;
+        entry.time = time;
+        entry.id = nextId++;
+        entry.plid = plid;
+        entry.code = protocols::packCode(colors);
+        entry.trials = trials;
+        entry.mode = mode;
+
+        int64_t now = Game::currentTime();
+        Mode byMode = mode == 'D' ? MODE_DEBUG : MODE_PLAY;
+        for (int w = 0; w < NUM_WINDOWS; w++) {
+            boards[MODE_ALL][w].insert(entry, now);
+            boards[byMode][w].insert(entry, now);
+        }
+    }
+
+    void Index::onScoreRecorded(const Game& game, int score, time_t now) {
+        add(score, strtoul(game.getPlid().c_str(), nullptr, 10), game.getSecretKey(),
+            game.getTrialCount(), game.getGameMode(), now);
+    }
+
+    bool Index::rank(Mode mode, Window window, uint32_t plid, int64_t now,
+                     size_t& rank, size_t& total, Entry& best) {
+        Board& board = boards[mode][window];
+        board.expire(now);
+        total = board.size();
+        const Entry* entry = board.best(plid);
+        if (!entry) return false;
+        best = *entry;
+        rank = board.rank(best);
+        return true;
+    }
+
+    void Index::position(Mode mode, Window window, uint32_t plid, int score, int64_t time,
+                         int64_t now, size_t& rank, size_t& total) {
+        Board& board = boards[mode][window];
+        board.expire(now);
+        total = board.size();
+        Entry probe = Entry();
+        probe.score = score;
+        probe.time = time;
+        probe.plid = plid;
+        rank = board.rank(probe);
+    }
+
+    std::vector<Entry> Index::range(Mode mode, Window window, size_t first, size_t count,
+                                    int64_t now, size_t& total) {
+        Board& board = boards[mode][window];
+        board.expire(now);
+        total = board.size();
+        return board.range(first, count);
+    }
+}
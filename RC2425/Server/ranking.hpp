@@ -0,0 +1,114 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <queue>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+#include "game_listener.hpp"
+
+// Score index behind the RNK and LDB requests.
+//
+// Every win is kept in one board per mode (all, PLAY, DEBUG) and window
+// (all time, last day, last week). A board is an order statistic tree
+// (rank and k-th entry in O(log n)) with the best entry of each player on
+// the side, so a player's rank, and a page of the board, cost O(log n)
+// (plus the page). The windowed boards drop entries as they get older
+// than the window. The index is loaded from the score files when the GS
+// starts and then follows the wins as a GameListener.
+namespace ranking {
+
+    enum Mode { MODE_ALL, MODE_PLAY, MODE_DEBUG, NUM_MODES };
+    enum Window { WINDOW_ALL, WINDOW_DAY, WINDOW_WEEK, NUM_WINDOWS };
+
+    extern const char* MODE_NAMES[NUM_MODES];     // "ALL", "PLAY", "DEBUG"
+    extern const char* WINDOW_NAMES[NUM_WINDOWS]; // "ALL", "DAY", "WEEK"
+    const int64_t WINDOW_SECONDS[NUM_WINDOWS] = {0, 24 * 3600, 7 * 24 * 3600};
+
+    // Index of a name, -1 if it is not one
+    int modeIndex(const std::string& name);
+    int windowIndex(const std::string& name);
+
+    struct Entry {
+        int score;
+        int64_t time;       // when the game was won
+        uint64_t id;        // insertion order, unique
+        uint32_t plid;
+        uint16_t code;      // secret, protocols::packCode
+        uint8_t trials;
+        char mode;          // 'P' or 'D'
+    };
+
+    // Best first: higher score, then the earlier win, then the lower PLID
+    // (so the order survives reloading the score files)
+    struct Better {
+        bool operator()(const Entry& a, const Entry& b) const {
+            if (a.score != b.score) return a.score > b.score;
+            if (a.time != b.time) return a.time < b.time;
+            if (a.plid != b.plid) return a.plid < b.plid;
+            return a.id < b.id;
+        }
+    };
+
+    class Board {
+    public:
+        Board() : window(0) {}
+        void setWindow(int64_t seconds) { window = seconds; }
+
+        void insert(const Entry& entry, int64_t now);
+        // Drops the entries older than the window
+        void expire(int64_t now);
+
+        size_t size() const { return tree.size(); }
+        // Best entry of plid, nullptr if it has none
+        const Entry* best(uint32_t plid) const;
+        // 1 for the best entry
+        size_t rank(const Entry& entry) const { return tree.order_of_key(entry) + 1; }
+        // Entries ranked first to first + count - 1
+        std::vector<Entry> range(size_t first, size_t count) const;
+
+    private:
+        struct Later {
+            bool operator()(const Entry& a, const Entry& b) const { return a.time > b.time; }
+        };
+        typedef __gnu_pbds::tree<Entry, __gnu_pbds::null_type, Better, __gnu_pbds::rb_tree_tag,
+                                 __gnu_pbds::tree_order_statistics_node_update> Tree;
+
+        void erase(const Entry& entry);
+
+        Tree tree;
+        std::unordered_map<uint32_t, std::set<Entry, Better>> players;
+        std::priority_queue<Entry, std::vector<Entry>, Later> oldest; // windowed boards only
+        int64_t window;     // seconds, 0 for all time
+    };
+
+    class Index : public GameListener {
+    public:
+        Index();
+
+        // Adds the wins recorded in the score files of dir
+        void load(const std::string& dir);
+        void add(int score, uint32_t plid, const std::string& colors, int trials,
+                 char mode, int64_t time);
+        void onScoreRecorded(const Game& game, int score, time_t now) override;
+
+        // Rank of the best win of plid and number of entries of the board,
+        // false if plid has no win there
+        bool rank(Mode mode, Window window, uint32_t plid, int64_t now,
+                  size_t& rank, size_t& total, Entry& best);
+        // Rank a win of plid with score at time would have (1 + the entries
+        // better than it), whether or not plid has wins there
+        void position(Mode mode, Window window, uint32_t plid, int score, int64_t time,
+                      int64_t now, size_t& rank, size_t& total);
+        // Entries ranked first (1 for the best) to first + count - 1
+        std::vector<Entry> range(Mode mode, Window window, size_t first, size_t count,
+                                 int64_t now, size_t& total);
+
+    private:
+        Board boards[NUM_MODES][NUM_WINDOWS];
+        uint64_t nextId;
+    };
+}
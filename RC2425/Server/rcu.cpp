@@ -0,0 +1,74 @@
+#include "rcu.hpp"
+#include <stdexcept>
+
+namespace rcu {
+
+    namespace {
+        std::atomic<uint64_t> epoch(1);
+        // Epoch each reader slot entered its section in, 0 when closed
+        std::atomic<uint64_t> slots[MAX_READERS];
+
+        std::mutex slotMutex;
+        std::vector<int> freeSlots;
+        int usedSlots = 0;
+
+        // Slot of the calling thread, taken on its first section and given
+        // back when the thread exits
+        struct Slot {
+            int index = -1;
+            int depth = 0;
+
+            int get() {
+                if (index >= 0) return index;
+                std::lock_guard<std::mutex> lock(slotMutex);
+                if (!freeSlots.empty()) {
+                    index = freeSlots.back();
+                    freeSlots.pop_back();
+                } else if (usedSlots < MAX_READERS) {
+                    index = usedSlots++;
+                } else {
+                    throw std::runtime_error("Too many threads reading snapshots");
+                }
+                return index;
+            }
+
+            ~Slot() {
+                if (index < 0) return;
+                slots[index].store(0, std::memory_order_release);
+                std::lock_guard<std::mutex> lock(slotMutex);
+                freeSlots.push_back(index);
+            }
+        };
+
+        thread_local Slot slot;
+    }
+
+    ReadSection::ReadSection() {
+        if (slot.depth++ > 0) return;
+        int index = slot.get();
+        slots[index].store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // The epoch must be visible to writers before the snapshot is read
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    ReadSection::~ReadSection() {
+        if (--slot.depth > 0) return;
+        slots[slot.index].store(0, std::memory_order_release);
+    }
+
+    uint64_t advance() {
+        // Readers entering after this see the new snapshot
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    uint64_t oldestReader() {
+        uint64_t oldest = UINT64_MAX;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (int i = 0; i < MAX_READERS; i++) {
+            uint64_t seen = slots[i].load(std::memory_order_acquire);
+            if (seen != 0 && seen < oldest) oldest = seen;
+        }
+        return oldest;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+// Read-copy-update publication of immutable snapshots, with epoch based
+// reclamation.
+//
+// A writer builds a new snapshot and publishes it; readers on any thread
+// open a ReadSection and use the snapshot they got for as long as the
+// section stays open. A read costs two plain atomic stores and a fence
+// (no lock, no read-modify-write), so read-mostly data never makes its
+// readers wait for a writer. A replaced snapshot is freed by a later
+// publish once every section that could still hold it has closed: the
+// publish moves the global epoch forward, and each open section records
+// the epoch it started in.
+namespace rcu {
+
+    const int MAX_READERS = 64;     // threads with an open section at once
+
+    // Marks the calling thread as reading published snapshots until it is
+    // destroyed; sections of one thread may nest
+    class ReadSection {
+    public:
+        ReadSection();
+        ~ReadSection();
+        ReadSection(const ReadSection&) = delete;
+        ReadSection& operator=(const ReadSection&) = delete;
+    };
+
+    // Starts a new epoch and returns the previous one
+    uint64_t advance();
+    // Oldest epoch of an open section, UINT64_MAX when none is open
+    uint64_t oldestReader();
+
+    template <typename T>
+    class Published {
+    public:
+        explicit Published(T* initial = nullptr) : current(initial) {}
+        // No section may be open on the snapshots anymore
+        ~Published() {
+            delete current.load();
+            for (size_t i = 0; i < retired.size(); i++) delete retired[i].second;
+        }
+        Published(const Published&) = delete;
+        Published& operator=(const Published&) = delete;
+
+        // Snapshot valid until the caller's ReadSection closes (the writer
+        // thread may also read without one)
+        const T* get() const { return current.load(std::memory_order_acquire); }
+
+        // Makes next the current snapshot and frees the replaced ones that
+        // no reader can still hold
+        void publish(T* next) {
+            std::lock_guard<std::mutex> lock(writer);
+            T* old = current.load(std::memory_order_relaxed);
+            current.store(next, std::memory_order_release);
+            if (old) retired.push_back(std::make_pair(advance(), old));
+
+            uint64_t oldest = oldestReader();
+            size_t kept = 0;
+            for (size_t i = 0; i < retired.size(); i++) {
+                if (retired[i].first < oldest) {
+                    delete retired[i].second;
+                } else {
+                    retired[kept++] = retired[i];
+                }
+            }
+            retired.resize(kept);
+        }
+
+    private:
+        std::atomic<T*> current;
+        std::vector<std::pair<uint64_t, T*>> retired;   // epoch it was replaced in
+        std::mutex writer;
+    };
+}
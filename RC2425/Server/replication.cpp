@@ -0,0 +1,299 @@
+#include "replication.hpp"
+#include "server.hpp"
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+#include <sys/socket.h>
+
+namespace replication {
+
+    namespace {
+        // "R G B Y" <-> "RGBY"
+        std::string compact(const std::string& colors) {
+            std::string out;
+            for (size_t i = 0; i < colors.size(); i++) {
+                if (colors[i] != ' ') out += colors[i];
+            }
+            return out;
+        }
+
+        std::string expand(const char* colors) {
+            return std::string(1, colors[0]) + " " + colors[1] + " " + colors[2] + " " + colors[3];
+        }
+    }
+
+    int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool parse(const std::string& line, Event& event) {
+        char plid[7], colors[5];
+        long long when, ms;
+        const char* s = line.c_str();
+        event.type = line.empty() ? '\0' : line[0];
+        switch (event.type) {
+        case 'C':
+            if (sscanf(s, "C %6s %c %4s %d %lld %lld", plid, &event.mode, colors,
+                       &event.maxTime, &when, &ms) != 6) return false;
+            break;
+        case 'T':
+            if (sscanf(s, "T %6s %d %4s %d %d %lld %lld", plid, &event.trial, colors,
+                       &event.nB, &event.nW, &when, &ms) != 7) return false;
+            break;
+        case 'F':
+            if (sscanf(s, "F %6s %c %lld %lld", plid, &event.endCode, &when, &ms) != 4) return false;
+            colors[0] = '\0';
+            break;
+        case 'D': {
+            long long end;
+            int count, offset = 0;
+            if (sscanf(s, "D %6s %c %4s %d %lld %c %lld %lld %d%n", plid, &event.mode, colors,
+                       &event.maxTime, &when, &event.endCode, &end, &ms, &count, &offset) != 9 ||
+                count < 0 || count > MAX_ATTEMPTS) return false;
+            event.endTime = end;
+            event.trials.clear();
+            event.trialTimes.clear();
+            for (int t = 0; t < count; t++) {
+                char trial[5];
+                long long at;
+                int n = 0;
+                if (sscanf(s + offset, " %4s %lld%n", trial, &at, &n) != 2 || strlen(trial) != 4) return false;
+                offset += n;
+                event.trials.push_back(expand(trial));
+                event.trialTimes.push_back(at);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        if (event.type != 'F' && strlen(colors) != 4) return false;
+        event.plid = plid;
+        event.colors = event.type == 'F' ? "" : expand(colors);
+        event.time = when;
+        event.sentMs = ms;
+        return true;
+    }
+
+    std::string finishedLine(const std::string& plid, char mode, const std::string& secret,
+                             int maxTime, time_t startTime, char endCode, time_t time,
+                             const std::vector<std::string>& trials,
+                             const std::vector<time_t>& trialTimes) {
+        std::string line = "D " + plid + " " + mode + " " + compact(secret) + " " + std::to_string(maxTime) +
+                           " " + std::to_string(startTime) + " " + endCode + " " + std::to_string(time) +
+                           " " + std::to_string(nowMs()) + " " + std::to_string(trials.size());
+        for (size_t t = 0; t < trials.size(); t++) {
+            line += " " + compact(trials[t]) + " " + std::to_string(trialTimes[t]);
+        }
+        return line + "\n";
+    }
+
+    Sender::Sender(const struct sockaddr_in& standby)
+        : standby(standby), nextFinish(1), written(0), running(true), finishing(false), wantSnapshot(false),
+          fd(-1), unsent(0), unacked(0), droppedCount(0) {
+        thread = std::thread(&Sender::run, this);
+    }
+
+    Sender::~Sender() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        ready.notify_one();
+        thread.join();
+        if (fd != -1) close(fd);
+    }
+
+    void Sender::onGameCreated(const Game& game) {
+        push("C " + game.getPlid() + " " + game.getGameMode() + " " + compact(game.getSecretKey()) +
+             " " + std::to_string(game.getMaxTime()) + " " + std::to_string(game.getStartTime()) +
+             " " + std::to_string(nowMs()) + "\n");
+    }
+
+    void Sender::onTrialAppended(const Game& game, const std::string& trial,
+                                 int nB, int nW, time_t now) {
+        push("T " + game.getPlid() + " " + std::to_string(game.getTrialCount()) + " " + compact(trial) +
+             " " + std::to_string(nB) + " " + std::to_string(nW) + " " + std::to_string(now) +
+             " " + std::to_string(nowMs()) + "\n");
+    }
+
+    void Sender::onGameFinalized(const Game& game, char endCode, time_t now) {
+        // Kept even if the line is dropped, until the standby acknowledges it
+        Finish finish = {0, game.getPlid(), endCode, now};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finish.seq = nextFinish++;
+            finishes.push_back(finish);
+        }
+        unacked++;
+        push("F " + game.getPlid() + " " + endCode + " " + std::to_string(now) +
+             " " + std::to_string(nowMs()) + "\n", finish.seq);
+    }
+
+    void Sender::push(const std::string& line, uint64_t through) {
+        if (wantSnapshot) return;
+        if (unsent.load() >= MAX_BACKLOG) {
+            droppedCount++;
+            std::cerr << "Replication backlog full, resending the active games\n";
+            wantSnapshot = true;
+            return;
+        }
+        unsent++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Item item = {line, 1, through};
+            queue.push_back(item);
+        }
+        ready.notify_one();
+    }
+
+    std::vector<Finish> Sender::unacknowledged() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<Finish>(finishes.begin(), finishes.end());
+    }
+
+    void Sender::sendSnapshot(const std::string& finished, const std::string& state) {
+        {
+            // Queued changes are older than the snapshot; the finalizations
+            // among them are in finished
+            std::lock_guard<std::mutex> lock(mutex);
+            unsent -= queue.size();
+            queue.clear();
+            Item item = {finished + "S " + std::to_string(state.size()) + " " + std::to_string(nowMs()) +
+                         "\n" + state,
+                         (size_t)std::count(finished.begin(), finished.end(), '\n') + 1,
+                         finishes.empty() ? 0 : finishes.back().seq};
+            queue.push_back(item);
+            unsent++;
+            wantSnapshot = false;
+        }
+        ready.notify_one();
+    }
+
+    void Sender::flush(int timeoutMs) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+        }
+        ready.notify_one();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while ((unsent.load() > 0 || unacked.load() > 0) && fd.load() != -1 && !wantSnapshot &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    bool Sender::connectStandby() {
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s == -1) return false;
+        if (connect(s, (const struct sockaddr*)&standby, sizeof(standby)) == -1) {
+            close(s);
+            return false;
+        }
+        fd = s;
+        written = 0;
+        carried.clear();
+        acks.clear();
+        std::cout << "Replicating to the standby" << std::endl;
+        return true;
+    }
+
+    bool Sender::readAcks() {
+        char buffer[256];
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) acks.append(buffer, n);
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return false;
+
+        uint64_t applied = 0, through = 0;
+        size_t end;
+        while ((end = acks.find('\n')) != std::string::npos) {
+            unsigned long long count;
+            if (sscanf(acks.c_str(), "A %llu", &count) == 1) applied = count;
+            acks.erase(0, end + 1);
+        }
+        while (!carried.empty() && carried.front().first <= applied) {
+            through = carried.front().second;
+            carried.pop_front();
+        }
+        if (through > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!finishes.empty() && finishes.front().seq <= through) {
+                finishes.pop_front();
+                unacked--;
+            }
+        }
+        return true;
+    }
+
+    void Sender::run() {
+        std::string pending;    // items taken from the queue, not yet written
+        size_t pendingItems = 0, pendingLines = 0;
+        // Finalizations carried by the pending items, by line count
+        std::vector<std::pair<uint64_t, uint64_t>> pendingCarried;
+        while (true) {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait_for(lock, std::chrono::milliseconds(RETRY_MS),
+                               [this]() { return !running || (!queue.empty() && !wantSnapshot); });
+                if (!running) return;
+                while (!queue.empty() && !wantSnapshot) {
+                    const Item& item = queue.front();
+                    pending += item.text;
+                    pendingLines += item.lines;
+                    pendingItems++;
+                    if (item.through > 0) pendingCarried.push_back(std::make_pair(pendingLines, item.through));
+                    queue.pop_front();
+                }
+                stopping = finishing;
+            }
+            if (fd == -1) {
+                // A new connection starts with a snapshot, which replaces
+                // whatever was not sent on the previous one
+                if (stopping || !connectStandby()) continue;
+                unsent -= pendingItems;
+                pending.clear();
+                pendingItems = pendingLines = 0;
+                pendingCarried.clear();
+                wantSnapshot = true;
+                continue;
+            }
+            if (!readAcks()) {
+                std::cerr << "The standby closed the replication connection\n";
+                close(fd);
+                fd = -1;
+                continue;
+            }
+            if (pending.empty()) continue;
+
+            // Written as a whole; after a failure the next connection
+            // starts over from a snapshot
+            size_t total = 0;
+            while (total < pending.size()) {
+                ssize_t n = send(fd, pending.data() + total, pending.size() - total, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                total += n;
+            }
+            if (total < pending.size()) {
+                std::cerr << "Lost the connection to the standby\n";
+                close(fd);
+                fd = -1;
+                continue;
+            }
+            unsent -= pendingItems;
+            for (size_t i = 0; i < pendingCarried.size(); i++) {
+                carried.push_back(std::make_pair(written + pendingCarried[i].first, pendingCarried[i].second));
+            }
+            written += pendingLines;
+            pending.clear();
+            pendingItems = pendingLines = 0;
+            pendingCarried.clear();
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <netinet/in.h>
+#include "game_listener.hpp"
+
+// Hot standby replication of the GS ("GS -R host:port" on the primary,
+// "GS -S port" on the standby).
+//
+// The primary turns every change of game state into one text line and a
+// background thread streams the lines over TCP to the standby, which
+// applies them to its own games and files in order, so it keeps the same
+// active games, game files and scores and can serve STR/SSB. Lines carry
+// the times of the primary, so the standby writes byte identical files,
+// and the primary's clock in milliseconds, from which the standby measures
+// the replication lag. Applying a line twice changes nothing.
+//
+//   C PLID mode CCCC maxTime startTime ms     game created
+//   T PLID nT CCCC nB nW time ms              trial nT appended
+//   F PLID endCode time ms                    game finalized
+//   D PLID mode CCCC maxTime startTime endCode time ms nT CCCC t1 ... CCCC tnT
+//                                             finished game, whole
+//   S size ms                                 followed by size bytes of
+//                                             Server::encodeState
+//
+// Every connection starts with a snapshot (S) of the active games of the
+// primary, which the standby merges into its own, so a standby that was
+// restarted or missed changes catches up. The primary also sends one after
+// dropping changes, and a standby that finds a gap in the changes closes
+// the connection to get one.
+//
+// Finalizations are never dropped: the standby acknowledges the lines it
+// applied ("A count", lines and snapshots since the connection started)
+// and the primary keeps every finalization until then. A snapshot is
+// preceded by a D line for each one not acknowledged, read from the
+// finished game file, which the standby finalizes with the primary's end
+// code and time unless its own finished game file already exists.
+namespace replication {
+
+    // Lines kept for a standby that is down or slow; past it changes are
+    // dropped (and counted) and a snapshot is sent instead
+    const size_t MAX_BACKLOG = 1 << 16;
+    // Delay between attempts to reach the standby
+    const int RETRY_MS = 200;
+
+    struct Event {
+        char type;              // 'C', 'T', 'F' or 'D'
+        std::string plid;
+        char mode;
+        std::string colors;     // secret or trial, "R G B Y"
+        int maxTime;
+        int trial;
+        int nB, nW;
+        char endCode;
+        time_t time;            // start time for 'C' and 'D'
+        time_t endTime;         // 'D'
+        std::vector<std::string> trials;    // 'D', "R G B Y"
+        std::vector<time_t> trialTimes;     // 'D'
+        int64_t sentMs;         // primary's wall clock when the change was made
+    };
+
+    // A finalization the standby has not acknowledged
+    struct Finish {
+        uint64_t seq;
+        std::string plid;
+        char endCode;
+        time_t time;
+    };
+
+    // Wall clock in milliseconds
+    int64_t nowMs();
+    // Event of one line (without the newline), false if it is not one
+    bool parse(const std::string& line, Event& event);
+    // D line of a finished game (with its newline), trial times in seconds
+    std::string finishedLine(const std::string& plid, char mode, const std::string& secret,
+                             int maxTime, time_t startTime, char endCode, time_t time,
+                             const std::vector<std::string>& trials,
+                             const std::vector<time_t>& trialTimes);
+
+    // Primary side: queues the changes and sends them to the standby,
+    // reconnecting every RETRY_MS while it is unreachable
+    class Sender : public GameListener {
+    public:
+        Sender(const struct sockaddr_in& standby);
+        ~Sender();
+
+        void onGameCreated(const Game& game) override;
+        void onTrialAppended(const Game& game, const std::string& trial,
+                             int nB, int nW, time_t now) override;
+        void onGameFinalized(const Game& game, char endCode, time_t now) override;
+
+        // True while the standby waits for a snapshot of the active games,
+        // which the server thread then passes to sendSnapshot. Changes made
+        // meanwhile are not queued, the snapshot holds them
+        bool needsSnapshot() const { return wantSnapshot.load(); }
+        // Finalizations not acknowledged yet, oldest first, which the
+        // server thread passes back to sendSnapshot as D lines
+        std::vector<Finish> unacknowledged();
+        void sendSnapshot(const std::string& finished, const std::string& state);
+        // Waits at most timeoutMs for the queued changes to reach the
+        // standby, without reconnecting (a new GS may own the standby now)
+        void flush(int timeoutMs);
+
+        // Lines not yet written to the standby
+        size_t backlog() const { return unsent.load(); }
+        // Finalizations the standby has not acknowledged
+        size_t unfinished() const { return unacked.load(); }
+        uint64_t dropped() const { return droppedCount.load(); }
+        bool connected() const { return fd.load() != -1; }
+
+    private:
+        // Lines queued as one write; through is the last finalization they
+        // carry (0 for none)
+        struct Item {
+            std::string text;
+            size_t lines;
+            uint64_t through;
+        };
+
+        void push(const std::string& line, uint64_t through = 0);
+        void run();
+        bool connectStandby();
+        // Reads the acknowledgements of the standby, false once it is gone
+        bool readAcks();
+
+        struct sockaddr_in standby;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Item> queue;
+        std::deque<Finish> finishes;    // not acknowledged, oldest first
+        uint64_t nextFinish;
+        // Connection: lines written, the finalizations they carry by line
+        // count, and the partial acknowledgement read
+        uint64_t written;
+        std::deque<std::pair<uint64_t, uint64_t>> carried;
+        std::string acks;
+        bool running;
+        bool finishing;
+        std::atomic<bool> wantSnapshot;
+        std::atomic<int> fd;
+        std::atomic<size_t> unsent;
+        std::atomic<size_t> unacked;
+        std::atomic<uint64_t> droppedCount;
+        std::thread thread;
+    };
+}
@@ -0,0 +1,115 @@
+#include "scoreboard.hpp"
+#include "server.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <dirent.h>
+
+namespace scoreboard {
+
+    namespace {
+        bool better(const Entry& a, const Entry& b) {
+            return strcmp(a.name.c_str(), b.name.c_str()) > 0;
+        }
+    }
+
+    int scan(const std::string& dir, std::vector<Entry>& top) {
+        struct dirent** filelist;
+        int n_entries;
+
+        // Scan SCORES directory for files
+        top.clear();
+        GS_TRACE0(scores__scan__start);
+        n_entries = scandir(dir.c_str(), &filelist, nullptr, alphasort);
+        if (n_entries <= 0) {
+            GS_TRACE2(scores__scan__end, n_entries, 0);
+            return 0;
+        }
+        int total_entries = n_entries;
+
+        while (n_entries--) {
+            const char* name = filelist[n_entries]->d_name;
+            if (name[0] != '.' && top.size() < static_cast<size_t>(TOP_SIZE)) {
+                FILE* fp = fopen((dir + name).c_str(), "r");
+                if (fp != NULL) {
+                    Entry entry;
+                    char plid[16], mode[8], c1, c2, c3, c4;
+                    if (fscanf(fp, "%d %15s %c %c %c %c %d %7s", &entry.score, plid,
+                               &c1, &c2, &c3, &c4, &entry.trials, mode) == 8) {
+                        entry.name = name;
+                        entry.plid = plid;
+                        entry.code = std::string(1, c1) + c2 + c3 + c4;
+                        entry.mode = mode;
+                        top.push_back(entry);
+                    }
+                    fclose(fp);
+                }
+            }
+            free(filelist[n_entries]);
+        }
+        free(filelist);
+
+        GS_TRACE2(scores__scan__end, total_entries, top.size());
+        return top.size();
+    }
+
+    std::string format(const std::vector<Entry>& top) {
+        if (top.empty()) return "";
+        std::stringstream content;
+        content << "-------------------------------- TOP 10 SCORES --------------------------------\n\n"
+               << "                 SCORE PLAYER     CODE    NO TRIALS   MODE\n\n";
+
+        for (size_t i = 0; i < top.size(); i++) {
+            content << "            "
+                    << std::right << std::setw(2) << (i + 1) << " - "
+                    << std::right << std::setw(4) << top[i].score << "  "
+                    << std::left << std::setw(10) << top[i].plid << " "
+                    << std::left << std::setw(8) << top[i].code << "    "
+                    << std::right << std::setw(1) << top[i].trials << "       "
+                    << std::left << top[i].mode
+                    << "\n";
+        }
+
+        content << "\n";
+        return content.str();
+    }
+
+    void Board::load(const std::string& dir) {
+        std::vector<Entry> top;
+        scan(dir, top);
+        publish(top);
+    }
+
+    void Board::onScoreRecorded(const Game& game, int score, time_t now) {
+        // Runs on the writer thread, which may read without a section
+        const Snapshot* current = snapshot.get();
+        Entry entry;
+        entry.name = Game::scoreFileName(score, game.getPlid(), now);
+        if (current->top.size() == static_cast<size_t>(TOP_SIZE) && !better(entry, current->top.back())) {
+            return;
+        }
+        entry.score = score;
+        entry.plid = game.getPlid();
+        entry.code = game.getSecretKey();
+        entry.code.erase(std::remove(entry.code.begin(), entry.code.end(), ' '), entry.code.end());
+        entry.trials = game.getTrialCount();
+        entry.mode = game.getGameMode() == 'D' ? "DEBUG" : "PLAY";
+
+        // A score file written again in the same second replaces the entry
+        std::vector<Entry> top;
+        for (size_t i = 0; i < current->top.size(); i++) {
+            if (current->top[i].name != entry.name) top.push_back(current->top[i]);
+        }
+        top.insert(std::upper_bound(top.begin(), top.end(), entry, better), entry);
+        if (top.size() > static_cast<size_t>(TOP_SIZE)) top.pop_back();
+        publish(top);
+    }
+
+    void Board::publish(const std::vector<Entry>& top) {
+        Snapshot* next = new Snapshot();
+        next->top = top;
+        next->content = format(top);
+        snapshot.publish(next);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ctime>
+#include "game_listener.hpp"
+#include "rcu.hpp"
+
+// Top 10 scores behind the SSB request.
+//
+// The scoreboard is kept as an immutable snapshot (the 10 best score files
+// and the file sent to the players) published with rcu::Published: it is
+// read from the score files when the GS starts and replaced as a
+// GameListener when a win makes the top 10, so an SSB reads no files and
+// readers on any thread never wait for the writer. The order is the one
+// of the score file names, best last (SSS_PLID_DDMMYYYY_HHMMSS.txt).
+namespace scoreboard {
+
+    const int TOP_SIZE = 10;
+
+    struct Entry {
+        std::string name;   // score file name, the sort key
+        int score;
+        std::string plid;
+        std::string code;   // "RGBY"
+        int trials;
+        std::string mode;   // "PLAY" or "DEBUG"
+    };
+
+    struct Snapshot {
+        std::vector<Entry> top;     // best first
+        std::string content;        // formatted scoreboard, "" when empty
+    };
+
+    // Best TOP_SIZE score files of dir, best first; returns how many
+    int scan(const std::string& dir, std::vector<Entry>& top);
+    // Scoreboard file of the entries
+    std::string format(const std::vector<Entry>& top);
+
+    class Board : public GameListener {
+    public:
+        Board() : snapshot(new Snapshot()) {}
+
+        // Publishes the top of the score files of dir
+        void load(const std::string& dir);
+        void onScoreRecorded(const Game& game, int score, time_t now) override;
+
+        // Current snapshot, valid while the caller holds an rcu::ReadSection
+        const Snapshot* current() const { return snapshot.get(); }
+
+    private:
+        void publish(const std::vector<Entry>& top);
+
+        rcu::Published<Snapshot> snapshot;
+    };
+}
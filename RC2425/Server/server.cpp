@@ -1,21 +1,39 @@
 #include "server.hpp"
 #include "../constant.hpp"
 #include "../utils.hpp"
+#include "solver.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
 
 
 
 using namespace std;
 
+#ifdef GS_USDT
+GS_TRACE_PROBES(GS_TRACE_SEMAPHORE)
+#endif
+
 // Game implementation
+std::vector<GameListener*> Game::listeners;
+time_t (*Game::timeSource)() = Game::systemTime;
+std::string (*Game::secretSource)() = Game::randomSecret;
+
 Game::Game(const std::string& pid, int maxPlayTime, char mode)
     : plid(pid), maxTime(maxPlayTime), active(true), gameMode(mode) {
-    startTime = time(nullptr);
+    startTime = currentTime();
     generateSecretKey();
     saveInitialState();
 
 }
 
+Game::Game(const std::string& pid, int maxPlayTime, char mode,
+           const std::string& secret, time_t start)
+    : plid(pid), secretKey(secret), startTime(start), maxTime(maxPlayTime),
+      active(true), gameMode(mode) {}
+
 void Game::saveInitialState() const {
+    metrics::StageTimer timer(metrics::STAGE_PERSIST);
     std::ofstream file(getGameFilePath());
     if (!file) {
         std::cerr << "Error creating game file\n";
@@ -23,21 +41,23 @@ void Game::saveInitialState() const {
     }
 
     // Get formatted time strings
-    time_t now = time(nullptr);
-    struct tm* timeinfo = gmtime(&now);
+    struct tm* timeinfo = gmtime(&startTime);
     char timeStr[30];
     strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", timeinfo);
 
     // Write header: PPPPPP M CCCC T YYYY-MM-DD HH:MM:SS s
+    GS_TRACE2(game__write, plid.c_str(), 'S');
     file << std::setfill('0') << std::setw(6) << plid << " "
          << gameMode << " " << secretKey << " "
          << maxTime << " " << timeStr << " "
          << startTime << std::endl;
 
     file.close();
+    for (size_t i = 0; i < listeners.size(); i++) listeners[i]->onGameCreated(*this);
 }
 
-void Game::appendTrialToFile(const std::string& trial, int nB, int nW) const {
+void Game::appendTrialToFile(const std::string& trial, int nB, int nW, time_t now) const {
+    metrics::StageTimer timer(metrics::STAGE_PERSIST);
     std::ofstream file(getGameFilePath(), std::ios::app);
     if (!file) {
         std::cerr << "Cannot append to game file\n";
@@ -45,24 +65,29 @@ void Game::appendTrialToFile(const std::string& trial, int nB, int nW) const {
     }
 
     // Calculate seconds from start
-    time_t now = time(nullptr);
     int secondsFromStart = now - startTime;
 
     // Write trial line: T: CCCC B W s
+    GS_TRACE2(game__write, plid.c_str(), 'T');
     file << "T: " << trial << " " << nB << " " << nW << " " 
          << secondsFromStart << std::endl;
 
     file.close();
+    for (size_t i = 0; i < listeners.size(); i++) {
+        listeners[i]->onTrialAppended(*this, trial, nB, nW, now);
+    }
 }
 
-void Game::finalizeGame(char endCode) {
+void Game::finalizeGame(char endCode, time_t now) {
     if (!active) return;
+    metrics::StageTimer timer(metrics::STAGE_PERSIST);
+    GS_TRACE2(game__write, plid.c_str(), endCode);
     active = false;
     
     // Save score file only for winning games
     if (endCode == 'W') {
         try {
-            saveScoreFile();
+            saveScoreFile(now);
         } catch (const std::exception& e) {
             std::cerr << "Error saving score file: " << e.what() << std::endl;
         }
@@ -75,7 +100,6 @@ void Game::finalizeGame(char endCode) {
     // Add final timestamp line
     std::ofstream file(getGameFilePath(), std::ios::app);
     if (file) {
-        time_t now = time(nullptr);
         struct tm* timeinfo = gmtime(&now);
         char timeStr[30];
         strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", timeinfo);
@@ -87,59 +111,70 @@ void Game::finalizeGame(char endCode) {
         file.close();
     }
 
-    // Generate new filename with timestamp and end code
-    char newFileName[100];
-    time_t now = time(nullptr);
-    struct tm* timeinfo = gmtime(&now);
-    strftime(newFileName, sizeof(newFileName), "%Y%m%d_%H%M%S", timeinfo);
-    
-    std::string newPath = playerDir + "/" + newFileName + "_" + endCode + ".txt";
-    rename(getGameFilePath().c_str(), newPath.c_str());
+    rename(getGameFilePath().c_str(), finishedGamePath(plid, endCode, now).c_str());
+    for (size_t i = 0; i < listeners.size(); i++) listeners[i]->onGameFinalized(*this, endCode, now);
 }
 
 void Game::generateSecretKey() {
+    secretKey = secretSource();
+}
+
+std::string Game::randomSecret() {
     const std::vector<char> colors = {'R', 'G', 'B', 'Y', 'O', 'P'};
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(0, colors.size() - 1);
 
-    secretKey = "";
+    std::string secret;
     for(int i = 0; i < 4; i++) {
-        if (i > 0) secretKey += " "; 
-        secretKey += colors[dis(gen)]; 
+        if (i > 0) secret += " "; 
+        secret += colors[dis(gen)]; 
     }
+    return secret;
 }
 
-int Game::calculateScore() const {
+void Game::addTrial(const std::string& trial, int nB, int nW) {
+    trials.push_back(trial);
+    int code = solver::encodeCode(trial);
+    if (code >= 0) {
+        candidates.prune(code, solver::feedbackIndex(nB, nW));
+    }
+}
+
+int Game::score(int seconds, int maxTime, int trials) {
     // Calculate time component (0-50 points)
-    time_t now = time(nullptr);
-    int timeTaken = now - startTime;
-    double timePercentage = std::max(0.0, 1.0 - (double)timeTaken / maxTime);
+    double timePercentage = std::max(0.0, 1.0 - (double)seconds / maxTime);
     int timeScore = static_cast<int>(timePercentage * 50);
 
     // Calculate trials component (0-50 points)
-    double trialsPercentage = 1.0 - (double)trials.size() / MAX_ATTEMPTS;
+    double trialsPercentage = 1.0 - (double)trials / MAX_ATTEMPTS;
     int trialScore = static_cast<int>(trialsPercentage * 50);
 
     // Combine scores and ensure bounds
     return std::min(100, std::max(0, timeScore + trialScore));
 }
 
-void Game::saveScoreFile() const {
-    time_t now = time(nullptr);
+std::string Game::finishedGamePath(const std::string& plid, char endCode, time_t now) {
+    char fileName[100];
+    struct tm* timeinfo = gmtime(&now);
+    strftime(fileName, sizeof(fileName), "%Y%m%d_%H%M%S", timeinfo);
+    return "Server/GAMES/" + plid + "/" + fileName + "_" + endCode + ".txt";
+}
+
+std::string Game::scoreFileName(int score, const std::string& plid, time_t now) {
     struct tm* timeinfo = gmtime(&now);
     char timeStr[30];
     strftime(timeStr, sizeof(timeStr), "%d%m%Y_%H%M%S", timeinfo);
-    
-    int score = calculateScore();
-    
+
     // Format: "NNN PLID DDMMYYYY HHMMSS.txt"
-    std::string scoreFileName = "Server/SCORES/" + 
-                               std::to_string(score) + "_" +
-                               plid + "_" +
-                               std::string(timeStr) + ".txt";
-                               
-    std::ofstream scoreFile(scoreFileName);
+    return std::to_string(score) + "_" + plid + "_" + std::string(timeStr) + ".txt";
+}
+
+void Game::saveScoreFile(time_t now) const {
+    // From now, not the local clock: a standby writes the file of the
+    // primary's win at the time the primary gave
+    int score = Game::score(now - startTime, maxTime, trials.size());
+    std::ofstream scoreFile("Server/SCORES/" + scoreFileName(score, plid, now));
     if (!scoreFile) {
         std::cerr << "Cannot create score file\n";
         return;
@@ -154,14 +189,35 @@ void Game::saveScoreFile() const {
               << std::endl;
               
     scoreFile.close();
+    for (size_t i = 0; i < listeners.size(); i++) listeners[i]->onScoreRecorded(*this, score, now);
 }
 
 // Server implementation
-Server::Server(int port, bool verboseMode) : verbose(verboseMode) {
-    std::cout << "Server running on port " << port << std::endl;
+Server::Server(bool verboseMode) : verbose(verboseMode) {
+    FD_ZERO(&outputs);
     setupDirectory();
+    solver::init();
+    Game::addListener(&scoreIndex);
+    Game::addListener(&scoreBoard);
+    Game::addListener(&playerStats);
+}
+
+Server::Server(int port, bool verboseMode) : Server(verboseMode) {
+    std::cout << "Server running on port " << port << std::endl;
+    loadScores();
     setupSockets(port);
-    run();
+}
+
+void Server::loadScores() {
+    scoreIndex.load("Server/SCORES/");
+    scoreBoard.load("Server/SCORES/");
+}
+
+Server::~Server() {
+    Game::removeListener(&scoreIndex);
+    Game::removeListener(&scoreBoard);
+    Game::removeListener(&playerStats);
+    if (replicator) Game::removeListener(replicator.get());
 }
 
 void Server::setupDirectory() {
@@ -180,6 +236,14 @@ void Server::setupDirectory() {
             exit(EXIT_FAILURE);
         }
     }
+
+    // Create STATS directory if it doesn't exist
+    if (mkdir("Server/STATS", 0777) == -1) {
+        if (errno != EEXIST) {
+            perror("Error creating STATS directory");
+            exit(EXIT_FAILURE);
+        }
+    }
 }
 void Server::setupSockets(int port) {
     // Setup TCP socket
@@ -255,11 +319,481 @@ void Server::setupSockets(int port) {
     
 }
 
+void Server::startReplication(const struct sockaddr_in& standbyAddr) {
+    replicator.reset(new replication::Sender(standbyAddr));
+    Game::addListener(replicator.get());
+}
+
+bool Server::startStandby(int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    int yes = 1;
+    replicaFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (replicaFd == -1 ||
+        setsockopt(replicaFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+        bind(replicaFd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(replicaFd, 1) == -1) {
+        std::cerr << "Cannot listen for replication on port " << port << "\n";
+        return false;
+    }
+    FD_SET(replicaFd, &inputs);
+    standby = true;
+    std::cout << "Standby, replicating from port " << port << std::endl;
+    return true;
+}
+
+void Server::acceptReplica() {
+    int fd = accept(replicaFd, NULL, NULL);
+    if (fd < 0) return;
+    // A primary that reconnects replaces its previous connection
+    if (replicaConn != -1) {
+        FD_CLR(replicaConn, &inputs);
+        close(replicaConn);
+    }
+    replicaConn = fd;
+    replicaBuffer.clear();
+    replicaApplied = 0;
+    replicaInSync = false;  // until the snapshot the primary starts with
+    FD_SET(replicaConn, &inputs);
+}
+
+void Server::readReplica() {
+    char buffer[BUFFER_SIZE];
+    ssize_t n = read(replicaConn, buffer, sizeof(buffer));
+    if (n <= 0) {
+        if (n < 0 && errno == EINTR) return;
+        std::cerr << "Replication connection closed\n";
+        FD_CLR(replicaConn, &inputs);
+        close(replicaConn);
+        replicaConn = -1;
+        return;
+    }
+    replicaBuffer.append(buffer, n);
+
+    size_t start = 0, end;
+    while ((end = replicaBuffer.find('\n', start)) != std::string::npos) {
+        std::string line = replicaBuffer.substr(start, end - start);
+        size_t size;
+        long long sentMs;
+        if (sscanf(line.c_str(), "S %zu %lld", &size, &sentMs) == 2) {
+            if (replicaBuffer.size() - (end + 1) < size) break;    // rest of the snapshot
+            applyReplicationSnapshot(replicaBuffer.substr(end + 1, size), sentMs);
+            replicaApplied++;
+            start = end + 1 + size;
+            continue;
+        }
+        replication::Event event;
+        if (!replication::parse(line, event)) {
+            std::cerr << "Invalid replication line\n";
+        } else if (!applyReplicationEvent(event)) {
+            // Drop the connection: the primary reconnects and starts over
+            // with a snapshot
+            std::cerr << "Missed changes of " << event.plid << ", resynchronizing\n";
+            metrics::count(metrics::CNT_REPLICATION_GAPS);
+            replicaInSync = false;
+            FD_CLR(replicaConn, &inputs);
+            close(replicaConn);
+            replicaConn = -1;
+            replicaBuffer.clear();
+            return;
+        }
+        replicaApplied++;
+        start = end + 1;
+    }
+    replicaBuffer.erase(0, start);
+
+    // Lets the primary forget the finalizations applied so far
+    if (start > 0) {
+        std::string ack = "A " + to_string(replicaApplied) + "\n";
+        send(replicaConn, ack.data(), ack.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+}
+
+bool Server::applyReplicationEvent(const replication::Event& event) {
+    auto it = findGame(event.plid);
+    if (event.type == 'C') {
+        if (it != activeGames.end()) {
+            if (it->second.getStartTime() == event.time) return true; // already applied
+            eraseGame(it);
+        }
+        Game game(event.plid, event.maxTime, event.mode, event.colors, event.time);
+        game.saveInitialState();
+        insertGame(event.plid, std::move(game));
+    } else if (event.type == 'T') {
+        if (it == activeGames.end() || it->second.getTrialCount() < event.trial - 1) return false;
+        if (it->second.getTrialCount() >= event.trial) return true;   // already applied
+        it->second.addTrial(event.colors, event.nB, event.nW);
+        it->second.appendTrialToFile(event.colors, event.nB, event.nW, event.time);
+    } else if (event.type == 'F') {
+        if (it == activeGames.end()) {
+            // Applied before, then resent in a D line or on a new connection
+            return access(Game::finishedGamePath(event.plid, event.endCode, event.time).c_str(), F_OK) == 0;
+        }
+        it->second.finalizeGame(event.endCode, event.time);
+        eraseGame(it);
+    } else {
+        // A game the primary finished while its changes were dropped,
+        // written again as needed and finalized as on the primary
+        if (access(Game::finishedGamePath(event.plid, event.endCode, event.endTime).c_str(), F_OK) == 0) {
+            return true;
+        }
+        if (it == activeGames.end() || it->second.getStartTime() != event.time ||
+            it->second.getTrialCount() > (int)event.trials.size()) {
+            if (it != activeGames.end()) eraseGame(it);
+            Game game(event.plid, event.maxTime, event.mode, event.colors, event.time);
+            game.saveInitialState();
+            it = insertGame(event.plid, std::move(game));
+        }
+        for (size_t t = it->second.getTrialCount(); t < event.trials.size(); t++) {
+            const std::string& trial = event.trials[t];
+            int nB = 0, nW = 0;
+            countMatches(trial.substr(0, 1), trial.substr(2, 1), trial.substr(4, 1), trial.substr(6, 1),
+                         event.colors, nB, nW);
+            it->second.addTrial(trial, nB, nW);
+            it->second.appendTrialToFile(trial, nB, nW, event.trialTimes[t]);
+        }
+        it->second.finalizeGame(event.endCode, event.endTime);
+        eraseGame(it);
+    }
+    replicationLagMs = std::max<int64_t>(0, replication::nowMs() - event.sentMs);
+    metrics::count(metrics::CNT_REPLICATED_CHANGES);
+    return true;
+}
+
+// Merges the active games of the primary: games the standby lacks or holds
+// in another state are written again, with the trials it missed timed at
+// the snapshot (their own times are not in it). Games absent from the
+// snapshot are left alone, since the primary may only hold some of its
+// games in memory (-m).
+void Server::applyReplicationSnapshot(const std::string& state, int64_t sentMs) {
+    StateHeader header;
+    std::vector<Game> games;
+    size_t end;
+    if (!decodeGames(state, header, games, end)) {
+        std::cerr << "Invalid replication snapshot\n";
+        return;
+    }
+    time_t now = sentMs / 1000;
+    int merged = 0;
+    for (size_t g = 0; g < games.size(); g++) {
+        const Game& game = games[g];
+        const std::vector<std::string>& trials = game.getTrials();
+        auto it = findGame(game.getPlid());
+        size_t have = 0;
+        if (it != activeGames.end() && it->second.getStartTime() == game.getStartTime() &&
+            it->second.getSecretKey() == game.getSecretKey() &&
+            it->second.getTrialCount() <= game.getTrialCount()) {
+            have = it->second.getTrialCount();
+            if (have < trials.size()) merged++;
+        } else {
+            Game copy(game.getPlid(), game.getMaxTime(), game.getGameMode(), game.getSecretKey(),
+                      game.getStartTime());
+            copy.saveInitialState();
+            it = insertGame(game.getPlid(), std::move(copy));
+            merged++;
+        }
+        for (size_t t = have; t < trials.size(); t++) {
+            int nB = 0, nW = 0;
+            countMatches(trials[t].substr(0, 1), trials[t].substr(2, 1), trials[t].substr(4, 1),
+                         trials[t].substr(6, 1), game.getSecretKey(), nB, nW);
+            it->second.addTrial(trials[t], nB, nW);
+            it->second.appendTrialToFile(trials[t], nB, nW, std::max(now, game.getStartTime()));
+        }
+    }
+    replicaInSync = true;
+    replicationLagMs = std::max<int64_t>(0, replication::nowMs() - sentMs);
+    std::cout << "Synchronized " << games.size() << " active games with the primary ("
+              << merged << " updated)" << std::endl;
+}
+
+bool Server::acceptUpgrades(const std::string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Upgrade socket path too long\n";
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    upgradeFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (upgradeFd == -1 || bind(upgradeFd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(upgradeFd, 1) == -1) {
+        std::cerr << "Cannot listen for upgrades on " << path << "\n";
+        return false;
+    }
+    FD_SET(upgradeFd, &inputs);
+    return true;
+}
+
+bool Server::takeOver(const std::string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        std::cerr << "Cannot reach the running GS on " << path << "\n";
+        if (fd != -1) close(fd);
+        return false;
+    }
+    std::string state;
+    std::vector<int> fds;
+    bool ok = protocols::receiveWithFds(fd, state, fds) && fds.size() == 2 && decodeState(state);
+    // The old GS keeps serving until it gets this byte
+    ok = ok && write(fd, "1", 1) == 1;
+    close(fd);
+    if (!ok) {
+        std::cerr << "Upgrade failed, the running GS keeps serving\n";
+        for (size_t i = 0; i < fds.size(); i++) close(fds[i]);
+        return false;
+    }
+
+    // Read only now: the old GS records no more wins after the handover
+    loadScores();
+    ufd = fds[0];
+    tfd = fds[1];
+    FD_ZERO(&inputs);
+    FD_SET(tfd, &inputs);
+    FD_SET(ufd, &inputs);
+    std::cout << "Took over the sockets and " << activeGames.size() << " active games" << std::endl;
+    return true;
+}
+
+bool Server::handOver() {
+    int fd = accept(upgradeFd, NULL, NULL);
+    if (fd < 0) return false;
+    struct timeval wait = {TIMEOUT_TIME, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+
+    std::vector<int> fds = {ufd, tfd};
+    char ack;
+    bool ok = protocols::sendWithFds(fd, encodeState(), fds) && read(fd, &ack, 1) == 1;
+    close(fd);
+    if (!ok) {
+        std::cerr << "Upgrade failed, still serving\n";
+        return false;
+    }
+    // Requests already queued on the sockets are read by the new GS
+    std::cout << "Handed the sockets and " << activeGames.size()
+              << " active games over to the new GS" << std::endl;
+    return true;
+}
+
+void Server::drain() {
+    // The new GS reads the sockets from now on
+    FD_ZERO(&inputs);
+    close(ufd);
+    close(tfd);
+    close(upgradeFd);
+    upgradeFd = -1;
+
+    time_t deadline = time(nullptr) + UPGRADE_DRAIN_TIMEOUT;
+    if (!exports.empty()) {
+        std::cout << "Finishing " << exports.size() << " exports" << std::endl;
+    }
+    while (!exports.empty() && time(nullptr) < deadline) {
+        writefds = outputs;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int ready = select(FD_SETSIZE, NULL, &writefds, NULL, &timeout);
+        if (ready < 0 && errno != EINTR) break;
+        serviceExports(ready);
+    }
+    if (!exports.empty()) {
+        std::cerr << "Dropping " << exports.size() << " unfinished exports\n";
+        while (!exports.empty()) closeExport(exports.begin()->first);
+    }
+
+    if (replicator) {
+        time_t left = std::max<time_t>(0, deadline - time(nullptr));
+        replicator->flush(left * 1000);
+        if (replicator->backlog() > 0) {
+            std::cerr << replicator->backlog() << " changes were not sent to the standby\n";
+        }
+    }
+    capture.flush();
+}
+
+// D lines of the finalizations the standby has not acknowledged, from the
+// finished game files (header, then "T: C C C C nB nW s" per trial)
+std::string Server::finishedGameLines(const std::vector<replication::Finish>& finishes) {
+    std::string lines;
+    for (size_t f = 0; f < finishes.size(); f++) {
+        const replication::Finish& finish = finishes[f];
+        std::vector<std::string> content = readGameFile(Game::finishedGamePath(finish.plid, finish.endCode,
+                                                                               finish.time));
+        char mode, c[4];
+        int maxTime;
+        long startTime;
+        if (content.empty() || sscanf(content[0].c_str(), "%*s %c %c %c %c %c %d %*s %*s %ld", &mode,
+                                      &c[0], &c[1], &c[2], &c[3], &maxTime, &startTime) != 7) {
+            std::cerr << "Cannot resend the finished game of " << finish.plid << " to the standby\n";
+            continue;
+        }
+        std::vector<std::string> trials;
+        std::vector<time_t> trialTimes;
+        for (size_t i = 1; i < content.size(); i++) {
+            char t[4];
+            int seconds;
+            if (sscanf(content[i].c_str(), "T: %c %c %c %c %*d %*d %d", &t[0], &t[1], &t[2], &t[3],
+                       &seconds) == 5) {
+                trials.push_back(formatColors(std::string(1, t[0]), std::string(1, t[1]),
+                                              std::string(1, t[2]), std::string(1, t[3])));
+                trialTimes.push_back(startTime + seconds);
+            }
+        }
+        lines += replication::finishedLine(finish.plid, mode,
+                                           formatColors(std::string(1, c[0]), std::string(1, c[1]),
+                                                        std::string(1, c[2]), std::string(1, c[3])),
+                                           maxTime, startTime, finish.endCode, finish.time, trials, trialTimes);
+    }
+    return lines;
+}
+
+std::string Server::encodeState() const {
+    StateHeader header;
+    memcpy(header.magic, "GSSTATE2", sizeof(header.magic));
+    header.games = activeGames.size();
+    header.scoreboards = sb_count;
+    std::string state(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (auto it = activeGames.begin(); it != activeGames.end(); ++it) {
+        const Game& game = it->second;
+        GameRecord record;
+        memcpy(record.plid, game.getPlid().data(), sizeof(record.plid));
+        record.mode = game.getGameMode();
+        record.trials = game.getTrialCount();
+        record.secret = protocols::packCode(game.getSecretKey());
+        record.maxTime = game.getMaxTime();
+        record.startTime = game.getStartTime();
+        state.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        for (int t = 0; t < record.trials; t++) {
+            uint16_t code = protocols::packCode(game.getTrials()[t]);
+            state.append(reinterpret_cast<const char*>(&code), sizeof(code));
+        }
+    }
+
+    uint32_t replies = replyCache.size();
+    state.append(reinterpret_cast<const char*>(&replies), sizeof(replies));
+    for (auto it = replyCache.begin(); it != replyCache.end(); ++it) {
+        const CachedReply& reply = it->second;
+        ReplyRecord record;
+        memcpy(record.plid, it->first.data(), sizeof(record.plid));
+        record.time = reply.time;
+        record.request = reply.request.size();
+        record.text = reply.text.size();
+        record.response = reply.response.size();
+        state.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        state += reply.request + reply.text + reply.response;
+    }
+    return state;
+}
+
+bool Server::decodeState(const std::string& state) {
+    StateHeader header;
+    std::vector<Game> games;
+    std::unordered_map<std::string, CachedReply> replies;
+    size_t pos;
+    // A GS of the previous version (GSSTATE1) hands over no reply cache
+    if (!decodeGames(state, header, games, pos) ||
+        (memcmp(header.magic, "GSSTATE2", sizeof(header.magic)) == 0 &&
+         !decodeReplies(state, pos, replies)) ||
+        pos != state.size()) {
+        return false;
+    }
+    for (size_t g = 0; g < games.size(); g++) {
+        std::string plid = games[g].getPlid();  // games[g] is moved from
+        insertGame(plid, std::move(games[g]));
+    }
+    replyCache.swap(replies);
+    sb_count = header.scoreboards;
+    return true;
+}
+
+bool Server::decodeGames(const std::string& state, StateHeader& header, std::vector<Game>& games,
+                         size_t& end) {
+    if (state.size() < sizeof(header)) return false;
+    memcpy(&header, state.data(), sizeof(header));
+    if (memcmp(header.magic, "GSSTATE1", sizeof(header.magic)) != 0 &&
+        memcmp(header.magic, "GSSTATE2", sizeof(header.magic)) != 0) {
+        return false;
+    }
+
+    size_t pos = sizeof(header);
+    for (uint32_t g = 0; g < header.games; g++) {
+        GameRecord record;
+        if (state.size() < pos + sizeof(record)) return false;
+        memcpy(&record, state.data() + pos, sizeof(record));
+        pos += sizeof(record);
+        if (state.size() < pos + record.trials * sizeof(uint16_t)) return false;
+
+        std::string plid(record.plid, sizeof(record.plid));
+        std::string secret = protocols::unpackCode(record.secret);
+        Game game(plid, record.maxTime, record.mode, secret, record.startTime);
+        for (int t = 0; t < record.trials; t++) {
+            uint16_t code;
+            memcpy(&code, state.data() + pos, sizeof(code));
+            pos += sizeof(code);
+            std::string trial = protocols::unpackCode(code);
+            int nB = 0, nW = 0;
+            countMatches(trial.substr(0, 1), trial.substr(2, 1), trial.substr(4, 1),
+                         trial.substr(6, 1), secret, nB, nW);
+            game.addTrial(trial, nB, nW);
+        }
+        games.push_back(std::move(game));
+    }
+    end = pos;
+    return true;
+}
+
+bool Server::decodeReplies(const std::string& state, size_t& pos,
+                           std::unordered_map<std::string, CachedReply>& replies) {
+    uint32_t count;
+    if (state.size() < pos + sizeof(count)) return false;
+    memcpy(&count, state.data() + pos, sizeof(count));
+    pos += sizeof(count);
+    for (uint32_t r = 0; r < count; r++) {
+        ReplyRecord record;
+        if (state.size() < pos + sizeof(record)) return false;
+        memcpy(&record, state.data() + pos, sizeof(record));
+        pos += sizeof(record);
+        size_t length = (size_t)record.request + record.text + record.response;
+        if (state.size() - pos < length) return false;
+
+        CachedReply& reply = replies[std::string(record.plid, sizeof(record.plid))];
+        reply.request = state.substr(pos, record.request);
+        reply.text = state.substr(pos + record.request, record.text);
+        reply.response = state.substr(pos + record.request + record.text, record.response);
+        reply.time = record.time;
+        pos += length;
+    }
+    return true;
+}
+
 void Server::run() {
     while (true) {
+        if (replicator && replicator->needsSnapshot()) {
+            replicator->sendSnapshot(finishedGameLines(replicator->unacknowledged()), encodeState());
+        }
         testfds = inputs;
-
-        int ready = select(FD_SETSIZE, &testfds, NULL, NULL, NULL);
+        writefds = outputs;
+
+        // Only poll while UDP requests are queued; otherwise wake up every
+        // second while capturing so idle periods flush, while exporting
+        // to drop the stalled exports, and while replicating so a standby
+        // that connects gets its snapshot
+        timeout.tv_sec = udpQueued > 0 ? 0 : 1;
+        timeout.tv_usec = 0;
+        int ready = select(FD_SETSIZE, &testfds, exports.empty() ? NULL : &writefds, NULL,
+                           udpQueued > 0 || capture.isOpen() || !exports.empty() || replicator
+                               ? &timeout : NULL);
         
         if (ready < 0) {
             if (errno == EINTR) continue;
@@ -267,33 +801,182 @@ void Server::run() {
             return;
         }
 
-        if (FD_ISSET(ufd, &testfds)) {
-            struct sockaddr_in client_addr;
-            socklen_t addrlen = sizeof(client_addr);
-            std::string message = protocols::receiveUDPMessage(ufd, &client_addr, &addrlen);
-            std::string response = handleRequest(message, false, &client_addr);
-            
-            protocols::sendUDPMessage(ufd, response, &client_addr, addrlen);
+        serviceExports(ready);
+
+        if (ready == 0 && udpQueued == 0) {
+            capture.flush();
+            continue;
         }
+
+        if (ready > 0 && FD_ISSET(ufd, &testfds)) {
+            readUDP();
+        }
+        handleQueuedUDP(UDP_BATCH);
     
     
-        if (FD_ISSET(tfd, &testfds)) {
+        if (ready > 0 && FD_ISSET(tfd, &testfds)) {
             struct sockaddr_in client_addr;
             socklen_t addrlen = sizeof(client_addr);
             int client_fd = accept(tfd, (struct sockaddr*)&client_addr, &addrlen);
             
             if (client_fd >= 0) {
                 std::string message = protocols::receiveTCPMessage(client_fd);
+                capture.record(capture::REQUEST, true, &client_addr, message);
+                std::string command = commandOf(message);
+                if (udpQueued > 0 && (command == REQUEST_SHOW_TRIALS || command == REQUEST_SCOREBOARD ||
+                                      command == REQUEST_EXPORT)) {
+                    // File requests wait for the game requests
+                    shedRequest(message, true, client_fd, &client_addr, addrlen);
+                    close(client_fd);
+                    continue;
+                }
+                pendingExport.reset();
                 std::string response = handleRequest(message, true, &client_addr);
                 
-                protocols::sendTCPMessage(client_fd, response);
+                capture.record(capture::RESPONSE, true, &client_addr, response);
+                GS_TRACE2(response__sent, 1, response.size());
+                if (pendingExport) {
+                    // The games follow the header as the client reads them
+                    startExport(client_fd, response);
+                } else {
+                    protocols::sendTCPMessage(client_fd, response);
+                    close(client_fd);
+                }
+            }
+        }
 
-                close(client_fd);
+        if (ready <= 0) continue;
+        if (upgradeFd != -1 && FD_ISSET(upgradeFd, &testfds)) {
+            // The requests already read are answered by this GS
+            handleQueuedUDP(udpQueued);
+            if (handOver()) {
+                drain();
+                return;
             }
         }
+        if (replicaFd != -1 && FD_ISSET(replicaFd, &testfds)) {
+            acceptReplica();
+        }
+        if (replicaConn != -1 && FD_ISSET(replicaConn, &testfds)) {
+            readReplica();
+        }
     }
 }
 
+void Server::serviceExports(int ready) {
+    time_t now = time(nullptr);
+    for (auto it = exports.begin(); it != exports.end();) {
+        int fd = (it++)->first;
+        if (ready > 0 && FD_ISSET(fd, &writefds)) {
+            if (!pumpExport(fd, exports[fd])) closeExport(fd);
+        } else if (now - exports[fd].lastProgress > EXPORT_IDLE_TIMEOUT) {
+            std::cerr << "Dropping the stalled export of " << exports[fd].plid << "\n";
+            closeExport(fd);
+        }
+    }
+}
+
+// Reads the waiting datagrams (at most UDP_QUEUE_LIMIT) into the queues,
+// shedding the least urgent requests once the queues are full
+void Server::readUDP() {
+    char buffer[BUFFER_SIZE];
+    for (int n = 0; n < UDP_QUEUE_LIMIT; n++) {
+        QueuedRequest request;
+        request.addrlen = sizeof(request.addr);
+        ssize_t len = recvfrom(ufd, buffer, sizeof(buffer), MSG_DONTWAIT,
+                               (struct sockaddr*)&request.addr, &request.addrlen);
+        if (len < 0 && errno == EINTR) continue;
+        if (len < 0) break;
+        request.message.assign(buffer, len);
+        // Recorded when handled, right before the response
+        request.receivedNs = capture.isOpen() ? capture::now() : 0;
+
+        int priority = priorityOf(commandOf(request.message));
+        if (udpQueued >= UDP_QUEUE_LIMIT) {
+            int victim = NUM_PRIORITIES - 1;
+            while (victim > priority && udpQueue[victim].empty()) victim--;
+            if (victim == priority) {
+                capture.record(capture::REQUEST, false, &request.addr, request.message, request.receivedNs);
+                shedRequest(request.message, false, ufd, &request.addr, request.addrlen);
+                continue;
+            }
+            QueuedRequest& shed = udpQueue[victim].back();
+            capture.record(capture::REQUEST, false, &shed.addr, shed.message, shed.receivedNs);
+            shedRequest(shed.message, false, ufd, &shed.addr, shed.addrlen);
+            udpQueue[victim].pop_back();
+            udpQueued--;
+        }
+        udpQueue[priority].push_back(std::move(request));
+        udpQueuePeak = std::max(udpQueuePeak, ++udpQueued);
+    }
+}
+
+void Server::handleQueuedUDP(size_t max) {
+    for (size_t n = 0; n < max && udpQueued > 0; n++) {
+        int priority = 0;
+        while (udpQueue[priority].empty()) priority++;
+        QueuedRequest request = std::move(udpQueue[priority].front());
+        udpQueue[priority].pop_front();
+        udpQueued--;
+
+        capture.record(capture::REQUEST, false, &request.addr, request.message, request.receivedNs);
+        std::string response = handleRequest(request.message, false, &request.addr);
+        protocols::sendUDPMessage(ufd, response, &request.addr, request.addrlen);
+        capture.record(capture::RESPONSE, false, &request.addr, response);
+        GS_TRACE2(response__sent, 0, response.size());
+    }
+}
+
+void Server::shedRequest(const std::string& message, bool isTCP, int fd,
+                         const struct sockaddr_in* addr, socklen_t addrlen) {
+    std::string command = commandOf(message);
+    std::string text = busyResponse(command);
+    std::string response = text;
+    protocols::BinaryHeader header;
+    if (protocols::isBinaryFrame(message) && protocols::decodeBinaryHeader(message, header)) {
+        response = protocols::encodeBinaryResponse(text, header);
+    }
+    if (isTCP) {
+        protocols::sendTCPMessage(fd, response);
+    } else {
+        protocols::sendUDPMessage(fd, response, const_cast<struct sockaddr_in*>(addr), addrlen);
+    }
+    capture.record(capture::RESPONSE, isTCP, addr, response);
+    metrics::recordRequest(metrics::commandIndex(command.c_str()), text, message.size(), response.size());
+    metrics::count(metrics::CNT_SHED_REQUESTS);
+}
+
+std::string Server::commandOf(const std::string& message) {
+    protocols::BinaryHeader header;
+    if (protocols::isBinaryFrame(message)) {
+        return protocols::decodeBinaryHeader(message, header) ? protocols::binaryCommandName(header.opcode) : "";
+    }
+    char command[10] = "";
+    sscanf(message.c_str(), "%9s", command);
+    return command;
+}
+
+Server::Priority Server::priorityOf(const std::string& command) {
+    if (command == REQUEST_TRY || command == REQUEST_QUIT) return PRIORITY_GAME;
+    if (command == REQUEST_START || command == REQUEST_DEBUG || command == REQUEST_BATCH) {
+        return PRIORITY_NEW;
+    }
+    return PRIORITY_OTHER;
+}
+
+std::string Server::busyResponse(const std::string& command) {
+    static const char* RESPONSES[][2] = {
+        {REQUEST_START, RESPONSE_START}, {REQUEST_TRY, RESPONSE_TRY}, {REQUEST_QUIT, RESPONSE_QUIT},
+        {REQUEST_DEBUG, RESPONSE_DEBUG}, {REQUEST_HINT, RESPONSE_HINT}, {REQUEST_BATCH, RESPONSE_BATCH},
+        {REQUEST_SHOW_TRIALS, RESPONSE_SHOW_TRIALS}, {REQUEST_SCOREBOARD, RESPONSE_SCOREBOARD},
+        {REQUEST_EXPORT, RESPONSE_EXPORT}
+    };
+    for (size_t i = 0; i < sizeof(RESPONSES) / sizeof(RESPONSES[0]); i++) {
+        if (command == RESPONSES[i][0]) return std::string(RESPONSES[i][1]) + " " STATUS_BUSY "\n";
+    }
+    return "ERR\n";
+}
+
 std::string Server::formatClientInfo(const struct sockaddr_in* client_addr) {
     char ipstr[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &(client_addr->sin_addr), ipstr, INET_ADDRSTRLEN);
@@ -302,30 +985,69 @@ std::string Server::formatClientInfo(const struct sockaddr_in* client_addr) {
 
 std::string Server::handleRequest(const std::string& request, bool isTCP, 
                                     const struct sockaddr_in* client_addr) {
-    char command[10], plid[7];
+    char command[10] = "", plid[7] = "";
     std::string response;
-    sscanf(request.c_str(), "%s", command);
-
-    if (verbose) {
-        // Log incoming request
-        bool hasPlid = false;
-        if (sscanf(request.c_str(), "%*s %s", plid) == 1) {
-            hasPlid = true;
+    protocols::BinaryHeader header;
+    bool binary = protocols::isBinaryFrame(request);
+    GS_TRACE3(request__received, isTCP, request.size(), request.c_str());
+    metrics::StageTimer parseTimer(metrics::STAGE_PARSE);
+    if (binary) {
+        if (protocols::decodeBinaryRequest(request, header)) {
+            strcpy(command, protocols::binaryCommandName(header.opcode));
+        } else {
+            binary = false; // answered as an unknown text request
         }
+    } else {
+        sscanf(request.c_str(), "%9s", command);
+    }
+    metrics::Command commandId = metrics::commandIndex(command);
+    parseTimer.stop();
+    if (GS_TRACE_ENABLED(request__parsed)) {
+        sscanf(binary ? protocols::binaryRequestToText(request).c_str() : request.c_str(), "%*s %6s", plid);
+    }
+    GS_TRACE2(request__parsed, command, plid);
 
-        std::cout << "Request from client: " << command << " ";
-        if (client_addr != nullptr) {
-            std::cout << formatClientInfo(client_addr) << "\n";
-        }
-        std::cout << "    Protocol: " << (isTCP ? "TCP" : "UDP") << "\n";
-        std::cout << "    Command: " << command;
-        if (hasPlid) {
-            std::cout << "\n    PLID: " << plid;
+    bool logged = verbose && logger::sampleRequest();
+    if (logged) {
+        // Log incoming request
+        std::string text = binary ? protocols::binaryRequestToText(request) : request;
+        if (plid[0] == '\0') {
+            sscanf(text.c_str(), "%*s %6s", plid);
         }
-        std::cout << "\n    Full request: " << request;
+        logger::request(client_addr, isTCP, command, plid, text);
     }
 
-    if (strcmp(command, REQUEST_START) == 0) {
+    metrics::StageTimer handleTimer(metrics::STAGE_HANDLE);
+    GS_TRACE1(handler__start, command);
+
+    // A UDP game request sent again (lost reply) gets the original reply
+    std::string cachePlid;
+    if (!isTCP && (commandId == metrics::CMD_SNG || commandId == metrics::CMD_TRY ||
+                   commandId == metrics::CMD_QUT || commandId == metrics::CMD_DBG)) {
+        char requestPlid[12] = "";
+        if (binary) {
+            snprintf(requestPlid, sizeof(requestPlid), "%06u", ntohl(header.plid));
+        } else {
+            sscanf(request.c_str(), "%*s %6s", requestPlid);
+        }
+        if (isValidPlid(requestPlid)) cachePlid = requestPlid;
+    }
+    const CachedReply* cached = cachePlid.empty() ? nullptr : findCachedReply(cachePlid, request);
+
+    std::string text;
+    if (cached) {
+        text = cached->text;
+        response = cached->response;
+        metrics::count(metrics::CNT_CACHED_REPLIES);
+    } else if (standby && commandId != metrics::CMD_STR && commandId != metrics::CMD_SSB &&
+               commandId != metrics::CMD_MTR && commandId != metrics::CMD_PRM &&
+               commandId != metrics::CMD_RNK && commandId != metrics::CMD_LDB &&
+               commandId != metrics::CMD_PST && commandId != metrics::CMD_EXP) {
+        // Game state only changes on the primary until this GS is promoted
+        response = "ERR\n";
+    } else if (binary) {
+        response = handleBinaryRequest(header, isTCP);
+    } else if (strcmp(command, REQUEST_START) == 0) {
         response = handleStartGame(request);
     } else if (strcmp(command, REQUEST_TRY) == 0) {
         response = handleTry(request);
@@ -333,27 +1055,356 @@ std::string Server::handleRequest(const std::string& request, bool isTCP,
         response = handleQuitExit(request);
     } else if (strcmp(command, REQUEST_DEBUG) == 0) {
         response = handleDebug(request);
+    } else if (strcmp(command, REQUEST_HINT) == 0) {
+        response = handleHint(request);
     } else if (strcmp(command, REQUEST_SHOW_TRIALS) == 0 && isTCP) {
         response = handleShowTrials(request);
     } else if (strcmp(command, REQUEST_SCOREBOARD) == 0 && isTCP) {
         response = handleScoreBoard();
+    } else if (strcmp(command, REQUEST_METRICS) == 0 && isTCP) {
+        response = handleMetrics(client_addr);
+    } else if (strcmp(command, REQUEST_BATCH) == 0 && !isTCP) {
+        response = handleBatch(request);
+    } else if (strcmp(command, REQUEST_PROMOTE) == 0 && isTCP) {
+        response = handlePromote(client_addr);
+    } else if (strcmp(command, REQUEST_RANK) == 0 && isTCP) {
+        response = handleRank(request);
+    } else if (strcmp(command, REQUEST_LEADERBOARD) == 0 && isTCP) {
+        response = handleLeaderboard(request);
+    } else if (strcmp(command, REQUEST_PLAYER_STATS) == 0 && isTCP) {
+        response = handlePlayerStats(request);
+    } else if (strcmp(command, REQUEST_EXPORT) == 0 && isTCP) {
+        response = handleExport(request);
     } else {
         response = "ERR\n";
     }
+    if (!cached) {
+        // Binary requests are answered in binary, the text reply is
+        // kept for metrics and logging
+        text = response;
+        if (binary) {
+            response = protocols::encodeBinaryResponse(text, header);
+        }
+        if (!cachePlid.empty()) {
+            cacheReply(cachePlid, request, text, response);
+        }
+    }
+    handleTimer.stop();
+    GS_TRACE2(handler__end, command, text.c_str());
+    metrics::recordRequest(commandId, text, request.size(), response.size());
 
-    if (verbose) {
+    if (logged) {
         // Log outgoing response
-        std::cout << "\nResponse to client:";
-        if (client_addr != nullptr) {
-            std::cout << " " << formatClientInfo(client_addr);
-        }
-        std::cout << "\n    Protocol: " << (isTCP ? "TCP" : "UDP") << "\n";
-        std::cout << "    Response: " << response;
-        std::cout << std::endl;
+        logger::response(client_addr, isTCP, text);
     }
     return response;
 }
 
+const Server::CachedReply* Server::findCachedReply(const std::string& plid, const std::string& request) {
+    auto it = replyCache.find(plid);
+    if (it == replyCache.end() || it->second.request != request ||
+        Game::currentTime() - it->second.time > REPLY_CACHE_WINDOW) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void Server::cacheReply(const std::string& plid, const std::string& request,
+                        const std::string& text, const std::string& response) {
+    time_t now = Game::currentTime();
+    CachedReply& entry = replyCache[plid];
+    entry.request = request;
+    entry.text = text;
+    entry.response = response;
+    entry.time = now;
+
+    // Now and then forget the replies too old to be retransmitted
+    if (++replyCacheInserts % 4096 == 0) {
+        for (auto it = replyCache.begin(); it != replyCache.end();) {
+            if (now - it->second.time > REPLY_CACHE_WINDOW) {
+                it = replyCache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+std::string Server::handleBinaryRequest(const protocols::BinaryHeader& header, bool isTCP) {
+    char plid[12];
+    snprintf(plid, sizeof(plid), "%06u", ntohl(header.plid));
+
+    // Missing or invalid codes unpack to "" and fail color validation
+    std::string colors = protocols::unpackCode(ntohs(header.code));
+    std::string c[4];
+    for (int i = 0; i < 4 && !colors.empty(); i++) {
+        c[i] = colors.substr(i * 2, 1);
+    }
+
+    switch (header.opcode) {
+    case protocols::OP_SNG:
+        return startGame(plid, ntohs(header.time));
+    case protocols::OP_TRY:
+        return playTrial(plid, c[0], c[1], c[2], c[3], header.nT);
+    case protocols::OP_QUT:
+        return quitGame(plid);
+    case protocols::OP_DBG:
+        return startDebugGame(plid, ntohs(header.time), c[0], c[1], c[2], c[3]);
+    case protocols::OP_HNT:
+        return hintGame(plid);
+    case protocols::OP_STR:
+        if (isTCP) return showTrials(plid);
+        break;
+    case protocols::OP_SSB:
+        if (isTCP) return handleScoreBoard();
+        break;
+    }
+    return "ERR\n";
+}
+
+std::string Server::handleMetrics(const struct sockaddr_in* client_addr) {
+    // Admin request: only answered on the loopback interface
+    if (client_addr == nullptr ||
+        (ntohl(client_addr->sin_addr.s_addr) >> 24) != 127) {
+        return "RMT ERR\n";
+    }
+
+    std::string content = metrics::report(activeGames.size());
+    content += "gs_log_dropped_total " + std::to_string(logger::dropped()) + "\n";
+    content += "gs_exports_active " + std::to_string(exports.size()) + "\n";
+    content += "gs_session_budget " + std::to_string(sessionBudget) + "\n";
+    content += "gs_udp_queue_depth " + std::to_string(udpQueued) + "\n";
+    content += "gs_udp_queue_peak " + std::to_string(udpQueuePeak) + "\n";
+    if (replicator) {
+        content += "gs_replication_connected " + std::to_string(replicator->connected() ? 1 : 0) + "\n";
+        content += "gs_replication_backlog " + std::to_string(replicator->backlog()) + "\n";
+        content += "gs_replication_dropped_total " + std::to_string(replicator->dropped()) + "\n";
+        content += "gs_replication_unacknowledged_finishes " + std::to_string(replicator->unfinished()) + "\n";
+    }
+    if (standby) {
+        content += "gs_standby 1\n";
+        content += "gs_replication_connected " + std::to_string(replicaConn != -1 ? 1 : 0) + "\n";
+        content += "gs_replication_lag_ms " + std::to_string(replicationLagMs) + "\n";
+        content += "gs_replication_in_sync " + std::to_string(replicaInSync ? 1 : 0) + "\n";
+    }
+    return "RMT OK metrics.txt " + std::to_string(content.length()) + " " + content;
+}
+
+std::string Server::handlePromote(const struct sockaddr_in* client_addr) {
+    // Admin request: only answered on the loopback interface
+    if (client_addr == nullptr ||
+        (ntohl(client_addr->sin_addr.s_addr) >> 24) != 127) {
+        return "RPM ERR\n";
+    }
+    if (!standby) {
+        return "RPM NOK\n";
+    }
+    if (!replicaInSync) {
+        std::cerr << "Not promoted: the standby has missed changes of the primary\n";
+        return "RPM NOK\n";
+    }
+
+    // Stop taking changes from the old primary; the games replicated so
+    // far are already in memory and on disk
+    if (replicaConn != -1) {
+        FD_CLR(replicaConn, &inputs);
+        close(replicaConn);
+        replicaConn = -1;
+    }
+    FD_CLR(replicaFd, &inputs);
+    close(replicaFd);
+    replicaFd = -1;
+    standby = false;
+    // Refusals cached while standing by must not answer retransmissions
+    replyCache.clear();
+    std::cout << "Promoted to primary, " << activeGames.size() << " active games" << std::endl;
+    return "RPM OK\n";
+}
+
+std::string Server::handleRank(const std::string& request) {
+    char plid[7], mode[8] = "ALL", window[8] = "ALL";
+    int score;
+    long long time;
+    int n = sscanf(request.c_str(), "RNK %6s %7s %7s %d %lld", plid, mode, window, &score, &time);
+    int m = ranking::modeIndex(mode), w = ranking::windowIndex(window);
+    if (n < 1 || n == 4 || !isValidPlid(plid) || m < 0 || w < 0) {
+        std::cerr << "Invalid RNK command\n";
+        return "RRK ERR\n";
+    }
+
+    size_t rank, total;
+    if (n == 5) {
+        // GSproxy ranking a win of another GS on this board
+        scoreIndex.position(static_cast<ranking::Mode>(m), static_cast<ranking::Window>(w),
+                            strtoul(plid, nullptr, 10), score, time, Game::currentTime(), rank, total);
+        return "RRK OK " + to_string(rank) + " " + to_string(total) + " " + to_string(score) + "\n";
+    }
+    ranking::Entry best;
+    if (!scoreIndex.rank(static_cast<ranking::Mode>(m), static_cast<ranking::Window>(w),
+                         strtoul(plid, nullptr, 10), Game::currentTime(), rank, total, best)) {
+        return "RRK NOK\n";
+    }
+    return "RRK OK " + to_string(rank) + " " + to_string(total) + " " + to_string(best.score) + "\n";
+}
+
+std::string Server::handleLeaderboard(const std::string& request) {
+    int first, count;
+    char mode[8] = "ALL", window[8] = "ALL";
+    int n = sscanf(request.c_str(), "LDB %d %d %7s %7s", &first, &count, mode, window);
+    int m = ranking::modeIndex(mode), w = ranking::windowIndex(window);
+    if (n < 2 || first < 1 || count < 1 || count > MAX_LEADERBOARD_PAGE || m < 0 || w < 0) {
+        std::cerr << "Invalid LDB command\n";
+        return "RLB ERR\n";
+    }
+
+    size_t total;
+    std::vector<ranking::Entry> entries = scoreIndex.range(
+        static_cast<ranking::Mode>(m), static_cast<ranking::Window>(w), first, count,
+        Game::currentTime(), total);
+    if (entries.empty()) {
+        return "RLB EMPTY\n";
+    }
+
+    std::string fileName = std::string("LEADERBOARD_") + mode + "_" + window + "_" +
+                           to_string(first) + ".txt";
+    std::stringstream content;
+    content << "---------------- LEADERBOARD " << mode << " " << window << ": RANKS " << first
+            << " TO " << (first + entries.size() - 1) << " OF " << total << " ----------------\n\n"
+            << "   RANK SCORE PLAYER CODE NO TRIALS MODE  DATE\n\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ranking::Entry& e = entries[i];
+        std::string code = protocols::unpackCode(e.code);
+        code.erase(std::remove(code.begin(), code.end(), ' '), code.end());
+        time_t when = e.time;
+        char date[30], line[128];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime(&when));
+        snprintf(line, sizeof(line), "%7zu %5d %06u %s %9d %-5s %s\n", first + i, e.score,
+                 e.plid, code.c_str(), e.trials, e.mode == 'D' ? "DEBUG" : "PLAY", date);
+        content << line;
+    }
+    content << "\n";
+
+    std::string fileContent = content.str();
+    return "RLB OK " + fileName + " " + to_string(fileContent.length()) + " " + fileContent + "\n";
+}
+
+std::string Server::handlePlayerStats(const std::string& request) {
+    char plid[7];
+    if (sscanf(request.c_str(), "PST %6s", plid) != 1 || !isValidPlid(plid)) {
+        std::cerr << "Invalid PST command\n";
+        return "RPS ERR\n";
+    }
+
+    stats::Record record;
+    if (!playerStats.get(plid, record)) {
+        return "RPS NOK\n";
+    }
+
+    // RPS OK games W F T Q best avgTrials avgSeconds wins1 ... wins8
+    char line[256];
+    snprintf(line, sizeof(line), "RPS OK %u %u %u %u %u %d %.2f %.1f", record.games,
+             record.ends[0], record.ends[1], record.ends[2], record.ends[3], record.bestScore,
+             (double)record.totalTrials / record.games, (double)record.totalSeconds / record.games);
+    std::string response = line;
+    for (int i = 1; i <= MAX_ATTEMPTS; i++) {
+        response += " " + to_string(record.wins[i]);
+    }
+    return response + "\n";
+}
+
+std::string Server::handleExport(const std::string& request) {
+    char plid[7];
+    if (sscanf(request.c_str(), "EXP %6s", plid) != 1 || !isValidPlid(plid) ||
+        exports.size() >= MAX_EXPORTS) {
+        std::cerr << "Invalid EXP command\n";
+        return "REX ERR\n";
+    }
+
+    // Finished games: YYYYMMDD_HHMMSS_C.txt
+    std::unique_ptr<Export> stream(new Export());
+    stream->plid = plid;
+    std::string playerDir = "Server/GAMES/" + std::string(plid);
+    DIR* dir = opendir(playerDir.c_str());
+    if (dir) {
+        struct dirent* entry;
+        unsigned day, second;
+        char endCode;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (sscanf(entry->d_name, "%8u_%6u_%c.txt", &day, &second, &endCode) == 3) {
+                stream->games.push_back(((uint64_t)day * 1000000 + second) * 256 + (uint8_t)endCode);
+            }
+        }
+        closedir(dir);
+    }
+    if (stream->games.empty()) {
+        return "REX NOK\n";
+    }
+    std::sort(stream->games.begin(), stream->games.end());
+
+    pendingExport = std::move(stream);
+    return "REX OK HISTORY_" + std::string(plid) + ".txt\n";
+}
+
+void Server::startExport(int fd, const std::string& header) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Export& stream = exports[fd];
+    stream = std::move(*pendingExport);
+    pendingExport.reset();
+    stream.buffer = header;
+    stream.sent = 0;
+    stream.lastProgress = time(nullptr);
+    FD_SET(fd, &outputs);
+}
+
+// Sends what the socket takes, reading at most one new chunk so a long
+// export does not hold up the other requests. False when it is done or
+// the client is gone.
+bool Server::pumpExport(int fd, Export& stream) {
+    bool filled = false;
+    while (true) {
+        if (stream.sent == stream.buffer.size()) {
+            if (stream.finished || filled) return !stream.finished;
+            fillExport(stream);
+            filled = true;
+        }
+        ssize_t n = send(fd, stream.buffer.data() + stream.sent, stream.buffer.size() - stream.sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n <= 0) return false;
+        stream.sent += n;
+        stream.lastProgress = time(nullptr);
+    }
+}
+
+// Next chunk: "size\n" and the next game files, each after a
+// "GAME YYYYMMDD_HHMMSS_C" line; the last one is followed by "0\n"
+void Server::fillExport(Export& stream) {
+    std::string data;
+    while (stream.next < stream.games.size() && data.size() < EXPORT_CHUNK) {
+        uint64_t game = stream.games[stream.next++];
+        char name[32];
+        snprintf(name, sizeof(name), "%08llu_%06llu_%c", (unsigned long long)(game / 256 / 1000000),
+                 (unsigned long long)(game / 256 % 1000000), (char)(game % 256));
+        std::ifstream file("Server/GAMES/" + stream.plid + "/" + name + ".txt");
+        if (!file) continue;
+        data += std::string("GAME ") + name + "\n";
+        data.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    stream.buffer = data.empty() ? "" : to_string(data.size()) + "\n" + data;
+    stream.sent = 0;
+    if (stream.next == stream.games.size()) {
+        stream.buffer += "0\n";
+        stream.finished = true;
+    }
+}
+
+void Server::closeExport(int fd) {
+    FD_CLR(fd, &outputs);
+    close(fd);
+    exports.erase(fd);
+}
+
 Server::GameFileStatus Server::checkGameFile(const std::string& plid) const {
     std::string gamePath = "Server/GAMES/GAME_" + plid + ".txt";
     FILE* file = fopen(gamePath.c_str(), "r");
@@ -363,7 +1414,7 @@ Server::GameFileStatus Server::checkGameFile(const std::string& plid) const {
     }
 
     char line[256];
-    time_t now = time(nullptr);
+    time_t now = Game::currentTime();
     int maxTime = 0;
     time_t startTime = 0;
     bool hasTries = false;
@@ -397,12 +1448,16 @@ Server::GameFileStatus Server::checkGameFile(const std::string& plid) const {
 std::string Server::handleStartGame(const std::string& request) {
     char plid[7];
     int time;
-    bool erased = false;
 
     if (sscanf(request.c_str(), "SNG %s %d", plid, &time) != 2) {
         std::cerr << "Failed to parse SNG command\n";
         return "RSG ERR\n";
     }
+    return startGame(plid, time);
+}
+
+std::string Server::startGame(const std::string& plid, int time) {
+    bool erased = false;
 
     if (!isValidPlid(plid) || time <= 0 || time > 600) {
         std::cerr << "Invalid SNG command\n";
@@ -410,11 +1465,11 @@ std::string Server::handleStartGame(const std::string& request) {
     }
 
     // Check if game already exists and finalize it if it is time exceeded
-    auto it = activeGames.find(plid);
+    auto it = findGame(plid);
     if (it != activeGames.end()) {
         if (it->second.isTimeExceeded()) {
             it->second.finalizeGame('T');
-            activeGames.erase(it);
+            eraseGame(it);
             erased = true;
         } else if (it->second.getTrials().size() > 0) {
             return "RSG NOK\n";
@@ -430,12 +1485,11 @@ std::string Server::handleStartGame(const std::string& request) {
     try {
         // Erase the old game if it exists
         if (it != activeGames.end() && erased == false) {
-            activeGames.erase(it);
+            eraseGame(it);
         }
         Game newGame(plid, time, 'P'); // 'P' for Play mode
-        std::cout << "PLID: " << plid << ": new game (max " << time << " sec);"
-                  << " Colors: " << newGame.getSecretKey() << "\n";
-        activeGames.insert(std::make_pair(plid, std::move(newGame)));
+        logger::newGame(plid, time, newGame.getSecretKey(), 'P');
+        insertGame(plid, std::move(newGame));
         return "RSG OK\n";
     } catch (const std::exception& e) {
         std::cerr << "Error creating game: " << e.what() << std::endl;
@@ -453,6 +1507,12 @@ std::string Server::handleTry(const std::string& request) {
         std::cerr << "Failed to parse TRY command\n";
         return "RTR ERR\n";
     }
+    return playTrial(plid, c1, c2, c3, c4, trialNum);
+}
+
+std::string Server::playTrial(const std::string& plid, const std::string& c1,
+                              const std::string& c2, const std::string& c3,
+                              const std::string& c4, int trialNum) {
 
     if (!isValidPlid(plid)) {
         std::cerr << "Invalid TRY command\n";
@@ -466,13 +1526,10 @@ std::string Server::handleTry(const std::string& request) {
     }
 
     // Check if game exists
-    auto it = activeGames.find(plid);
+    auto it = findGame(plid);
     if (it == activeGames.end()) {
-        it = loadGameFromFile(plid);
-        if (it == activeGames.end()) {
-            return "RTR NOK\n";
-        }
-    } 
+        return resendFinalTrial(plid, formatColors(c1, c2, c3, c4), trialNum);
+    }
 
     std::string secretKey;
     secretKey = it->second.getSecretKey();
@@ -480,7 +1537,7 @@ std::string Server::handleTry(const std::string& request) {
     // Check if game has timed out
     if (it->second.isTimeExceeded()) {
         it->second.finalizeGame('T');
-        activeGames.erase(it);
+        eraseGame(it);
         return "RTR ETM " + secretKey + "\n";
     }
 
@@ -496,8 +1553,7 @@ std::string Server::handleTry(const std::string& request) {
             // Resend the last response
             int nB = 0, nW = 0;
             countMatches(c1, c2, c3, c4, secretKey, nB, nW);
-            cout << "PLID: " << plid << ":try " << c1 << " " << c2 << " " << c3 
-                 << " " << c4 << " nB: " << nB << " nW: " << nW << " not guessed\n";
+            logger::trial(plid, guess, nB, nW, game.getCandidateCount(), 'R');
             return "RTR OK " + std::to_string(trialNum) + " " + 
                    std::to_string(nB) + " " + std::to_string(nW) + "\n";
         }
@@ -513,22 +1569,27 @@ std::string Server::handleTry(const std::string& request) {
     
     // Add trials and check if max attempts reached
     int nB = 0, nW = 0;
+    int candidatesBefore = game.getCandidateCount();
     countMatches(c1, c2, c3, c4, secretKey, nB, nW);
-    game.addTrial(guess);
+    game.addTrial(guess, nB, nW);
     game.appendTrialToFile(guess, nB, nW);
     
     if (game.getTrialCount() >= MAX_ATTEMPTS) {
         game.finalizeGame('F');
-        activeGames.erase(it);
+        eraseGame(it);
         return "RTR ENT " + secretKey + "\n";
     }
 
     // Check for win condition
     if (nB == 4) {
+        // Guessing right while many codes were still possible is what a
+        // player that knows the secret looks like
+        if (game.getGameMode() == 'P' && candidatesBefore >= SUSPICIOUS_CANDIDATES) {
+            logger::suspiciousSolve(plid, trialNum, candidatesBefore);
+        }
         game.finalizeGame('W');
-        activeGames.erase(it);
-        cout << "PLID: " << plid << ":try " << c1 << " " << c2 << " " << c3 
-             << " " << c4 << " nB: " << nB << " nW: " << nW << " Win (game ended)\n";
+        eraseGame(it);
+        logger::trial(plid, guess, nB, nW, 1, 'W');
         return "RTR OK " + std::to_string(trialNum) + " 4 0\n";
     }
     
@@ -540,41 +1601,17 @@ void Server::countMatches(const std::string& c1, const std::string& c2,
                          const std::string& c3, const std::string& c4,
                          const std::string& secret,
                          int& nB, int& nW) {
-    std::vector<std::string> secretColors;
-    char secretStr[20];
-    strcpy(secretStr, secret.c_str());
-    
-    char* token = strtok(secretStr, " ");
-    while (token != NULL) {
-        secretColors.push_back(std::string(token));
-        token = strtok(NULL, " ");
-    }
-    
-    std::vector<std::string> guess = {c1, c2, c3, c4};
-    std::vector<bool> usedGuess(4, false);
-    std::vector<bool> usedSecret(4, false);
-    
-    nB = 0;
-    for (size_t i = 0; i < 4; i++) {
-        if (guess[i] == secretColors[i]) {
-            nB++;
-            usedGuess[i] = true;
-            usedSecret[i] = true;
-        }
-    }
-    
-    nW = 0;
-    for (size_t i = 0; i < 4; i++) {
-        if (usedGuess[i]) continue;
-        
-        for (size_t j = 0; j < 4; j++) {
-            if (!usedSecret[j] && guess[i] == secretColors[j]) {
-                nW++;
-                usedSecret[j] = true;
-                break;
-            }
-        }
+    // Lookup in the feedback table of the solver
+    int guess = solver::encodeCode(c1 + c2 + c3 + c4);
+    int code = solver::encodeCode(secret);
+    if (guess < 0 || code < 0) {
+        nB = nW = 0;
+        return;
     }
+    int feedback = solver::score(guess, code);
+    nB = solver::feedbackBlack(feedback);
+    nW = solver::feedbackWhite(feedback);
+    GS_TRACE2(count__matches, nB, nW);
 }
 bool Server::isValidColor(const std::string& color) {
         return VALID_COLORS.find(color) != VALID_COLORS.end();
@@ -596,24 +1633,24 @@ std::string Server::handleQuitExit(const std::string& request) {
         std::cerr << "Failed to parse QUT command\n";
         return "RQT ERR\n";
     }
+    return quitGame(plid);
+}
+
+std::string Server::quitGame(const std::string& plid) {
 
     if (!isValidPlid(plid)) {
         return "RQT ERR\n";
     }
 
-    auto it = activeGames.find(plid);
-
     // Check if game exists
+    auto it = findGame(plid);
     if (it == activeGames.end()) {
-        it = loadGameFromFile(plid);
-        if (it == activeGames.end()) {
-            return "RQT NOK\n";
-        }
+        return "RQT NOK\n";
     }
 
     if (it->second.isTimeExceeded()) {
         it->second.finalizeGame('T');
-        activeGames.erase(it);
+        eraseGame(it);
         return "RQT NOK\n";
     }
 
@@ -622,7 +1659,7 @@ std::string Server::handleQuitExit(const std::string& request) {
         Game& game = it->second;
         std::string secretKey = game.getSecretKey();
         game.finalizeGame('Q');
-        activeGames.erase(it); 
+        eraseGame(it); 
         return "RQT OK " + secretKey + "\n";
     } catch (const std::exception& e) {
         std::cerr << "Error finalizing game: " << e.what() << std::endl;
@@ -633,14 +1670,19 @@ std::string Server::handleQuitExit(const std::string& request) {
 std::string Server::handleDebug(const std::string& request) {
     char plid[7], c1[2], c2[2], c3[2], c4[2];
     int time;
-    bool erased = false;
     
     if (sscanf(request.c_str(), "DBG %s %d %s %s %s %s", 
                plid, &time, c1, c2, c3, c4) != 6) {
         std::cerr << "Failed to parse DBG command\n";
         return "RDB ERR\n";
     }
+    return startDebugGame(plid, time, c1, c2, c3, c4);
+}
 
+std::string Server::startDebugGame(const std::string& plid, int time,
+                                   const std::string& c1, const std::string& c2,
+                                   const std::string& c3, const std::string& c4) {
+    bool erased = false;
 
 
     if (!isValidPlid(plid) || time <= 0 || time > 600) {
@@ -655,11 +1697,11 @@ std::string Server::handleDebug(const std::string& request) {
     }
 
     // Check for active game and tries
-    auto it = activeGames.find(plid);
+    auto it = findGame(plid);
     if (it != activeGames.end()) {
         if (it->second.isTimeExceeded()) {
             it->second.finalizeGame('T');
-            activeGames.erase(it);
+            eraseGame(it);
             erased = true;
         } else if (it->second.getTrials().size() > 0) {
             return "RDB NOK\n";
@@ -676,13 +1718,12 @@ std::string Server::handleDebug(const std::string& request) {
     try {
         // Erase the old game if it exists
         if (it != activeGames.end() && erased == false) {
-            activeGames.erase(it);
+            eraseGame(it);
         }
-        Game newGame(plid, time, 'D'); // 'D' for Debug mode
-        newGame.setSecretKey(key);
-        std::cout << "PLID: " << plid << ": new debug game (max " << time << " sec);"
-                  << " Colors: " << key << "\n";
-        activeGames.insert(std::make_pair(plid, std::move(newGame)));
+        Game newGame(plid, time, 'D', key, Game::currentTime()); // 'D' for Debug mode
+        newGame.saveInitialState();
+        logger::newGame(plid, time, key, 'D');
+        insertGame(plid, std::move(newGame));
         return "RDB OK\n";
     } catch (const std::exception& e) {
         std::cerr << "Error creating debug game: " << e.what() << std::endl;
@@ -690,6 +1731,88 @@ std::string Server::handleDebug(const std::string& request) {
     }
 }
 
+// "BAT N\n" followed by N SNG/TRY/QUT/DBG requests, one per line. Each one
+// goes through its usual handler, in order, and the reply is "RBT OK N\n"
+// followed by the N responses ("ERR\n" for any other command)
+std::string Server::handleBatch(const std::string& request) {
+    int count;
+    if (sscanf(request.c_str(), "BAT %d", &count) != 1 || count <= 0 || count > MAX_BATCH_REQUESTS) {
+        return "RBT ERR\n";
+    }
+
+    std::vector<std::string> lines;
+    size_t pos = request.find('\n');
+    while (pos != std::string::npos && pos + 1 < request.size()) {
+        size_t end = request.find('\n', pos + 1);
+        if (end == std::string::npos) break;
+        lines.push_back(request.substr(pos + 1, end - pos));
+        pos = end;
+    }
+    if ((int)lines.size() != count || pos + 1 != request.size()) {
+        std::cerr << "Invalid BAT command\n";
+        return "RBT ERR\n";
+    }
+
+    std::string response = "RBT OK " + std::to_string(count) + "\n";
+    for (size_t i = 0; i < lines.size(); i++) {
+        char command[10] = "";
+        sscanf(lines[i].c_str(), "%9s", command);
+
+        std::string reply;
+        if (strcmp(command, REQUEST_START) == 0) {
+            reply = handleStartGame(lines[i]);
+        } else if (strcmp(command, REQUEST_TRY) == 0) {
+            reply = handleTry(lines[i]);
+        } else if (strcmp(command, REQUEST_QUIT) == 0) {
+            reply = handleQuitExit(lines[i]);
+        } else if (strcmp(command, REQUEST_DEBUG) == 0) {
+            reply = handleDebug(lines[i]);
+        } else {
+            reply = "ERR\n";
+        }
+        // Each request is counted under its own command, the envelope
+        // bytes under BAT
+        metrics::recordRequest(metrics::commandIndex(command), reply, 0, 0);
+        response += reply;
+    }
+    return response;
+}
+
+std::string Server::handleHint(const std::string& request) {
+    char plid[7];
+
+    if (sscanf(request.c_str(), "HNT %6s", plid) != 1) {
+        std::cerr << "Failed to parse HNT command\n";
+        return "RHN ERR\n";
+    }
+    return hintGame(plid);
+}
+
+std::string Server::hintGame(const std::string& plid) {
+
+    if (!isValidPlid(plid)) {
+        return "RHN ERR\n";
+    }
+
+    auto it = findGame(plid);
+    if (it == activeGames.end()) {
+        return "RHN NOK\n";
+    }
+
+    if (it->second.isTimeExceeded()) {
+        it->second.finalizeGame('T');
+        eraseGame(it);
+        return "RHN NOK\n";
+    }
+
+    std::vector<uint16_t> candidates = it->second.getCandidates().toVector();
+    int guess = solver::bestGuess(candidates);
+    if (guess < 0) {
+        return "RHN NOK\n";
+    }
+    return "RHN OK " + solver::decodeCode(guess) + "\n";
+}
+
 std::string Server::handleShowTrials(const std::string& request) {
     char plid[7];
 
@@ -697,20 +1820,21 @@ std::string Server::handleShowTrials(const std::string& request) {
         std::cerr << "Failed to parse STR command\n";
         return "RST NOK\n";
     }
+    return showTrials(plid);
+}
+
+std::string Server::showTrials(const std::string& plid) {
 
     if (!isValidPlid(plid)) {
         return "RST NOK\n";
     }
 
-    auto it = activeGames.find(plid);
-    
-    if (it == activeGames.end()) {
-        it = loadGameFromFile(plid);
-    }
+    auto it = findGame(plid);
 
-    if (it != activeGames.end() && it->second.isTimeExceeded()) {
+    // A standby leaves the timeouts to the primary
+    if (it != activeGames.end() && it->second.isTimeExceeded() && !standby) {
         it->second.finalizeGame('T');
-        activeGames.erase(it);
+        eraseGame(it);
     }
 
     // Check for active game first
@@ -750,32 +1874,89 @@ std::vector<std::string> Server::readGameFile(const std::string& filePath) {
     return lines;
 }
 
+// Game of the player's game file with its secret, start time and trials
+// (a game evicted from memory, or left by an earlier GS); timed out games
+// are restored too, so the caller finalizes them as it would in memory
 std::map<std::string, Game>::iterator Server::loadGameFromFile(const std::string& plid) {
-    GameFileStatus status = checkGameFile(plid);
-    if (status != ACTIVE_GAME && status != ACTIVE_WITH_TRIES) {
+    std::string gamePath = "Server/GAMES/GAME_" + plid + ".txt";
+    if (access(gamePath.c_str(), F_OK) != 0) {
         return activeGames.end();
     }
 
     try {
-        std::vector<std::string> lines = readGameFile("Server/GAMES/GAME_" + plid + ".txt");
-        if (!lines.empty()) {
-            char mode;
-            int maxTime;
-            std::string secretKey;
-            time_t startTime;
-            if (sscanf(lines[0].c_str(), "%*s %c %*s %d %*s %*s %ld", 
-                      &mode, &maxTime, &startTime) == 3) {
-                Game newGame(plid, maxTime, mode);
-                newGame.setSecretKey(secretKey);
-                return activeGames.insert(std::make_pair(plid, std::move(newGame))).first;
+        // Header: PLID M C C C C maxTime date time start, then a
+        // "T: C C C C nB nW s" line per trial
+        std::vector<std::string> lines = readGameFile(gamePath);
+        char mode, c[4];
+        int maxTime;
+        long startTime;
+        if (lines.empty() || sscanf(lines[0].c_str(), "%*s %c %c %c %c %c %d %*s %*s %ld", &mode,
+                                    &c[0], &c[1], &c[2], &c[3], &maxTime, &startTime) != 7) {
+            std::cerr << "Invalid game file " << gamePath << "\n";
+            return activeGames.end();
+        }
+        std::string secret = formatColors(std::string(1, c[0]), std::string(1, c[1]),
+                                          std::string(1, c[2]), std::string(1, c[3]));
+        Game game(plid, maxTime, mode, secret, startTime);
+        for (size_t i = 1; i < lines.size(); i++) {
+            char t[4];
+            int nB, nW;
+            if (sscanf(lines[i].c_str(), "T: %c %c %c %c %d %d", &t[0], &t[1], &t[2], &t[3],
+                       &nB, &nW) == 6) {
+                game.addTrial(formatColors(std::string(1, t[0]), std::string(1, t[1]),
+                                           std::string(1, t[2]), std::string(1, t[3])), nB, nW);
             }
         }
+        return insertGame(plid, std::move(game));
     } catch (const std::exception& e) {
         std::cerr << "Error loading game from file: " << e.what() << std::endl;
     }
     return activeGames.end();
 }
 
+std::map<std::string, Game>::iterator Server::findGame(const std::string& plid) {
+    auto it = activeGames.find(plid);
+    if (it != activeGames.end()) {
+        sessionOrder.splice(sessionOrder.begin(), sessionOrder, sessionPos[plid]);
+        metrics::count(metrics::CNT_SESSION_HITS);
+        return it;
+    }
+    it = loadGameFromFile(plid);
+    if (it != activeGames.end()) {
+        metrics::count(metrics::CNT_SESSION_RESTORES);
+    }
+    return it;
+}
+
+std::map<std::string, Game>::iterator Server::insertGame(const std::string& plid, Game&& game) {
+    auto it = activeGames.find(plid);
+    if (it != activeGames.end()) {
+        eraseGame(it);
+    }
+    it = activeGames.insert(std::make_pair(plid, std::move(game))).first;
+    sessionOrder.push_front(plid);
+    sessionPos[plid] = sessionOrder.begin();
+
+    // Past the budget the least recently used games leave memory; their
+    // game files hold everything needed to restore them
+    while (sessionBudget > 0 && activeGames.size() > sessionBudget) {
+        activeGames.erase(sessionOrder.back());
+        sessionPos.erase(sessionOrder.back());
+        sessionOrder.pop_back();
+        metrics::count(metrics::CNT_SESSION_EVICTIONS);
+    }
+    return it;
+}
+
+void Server::eraseGame(std::map<std::string, Game>::iterator it) {
+    auto pos = sessionPos.find(it->first);
+    if (pos != sessionPos.end()) {
+        sessionOrder.erase(pos->second);
+        sessionPos.erase(pos);
+    }
+    activeGames.erase(it);
+}
+
 std::string Server::formatGameHeader(const std::string& plid, const std::string& date, 
                                    const std::string& time, int maxTime) {
     std::stringstream ss;
@@ -842,8 +2023,10 @@ std::string Server::processActiveGame(const std::string& plid, Game& game) {
         content += formatTrials(lines);
         
         // Add remaining time
-        int remainingTime = maxTime - (time(nullptr) - startTime);
+        int remainingTime = std::max<int>(0, maxTime - (Game::currentTime() - startTime));
         content += formatRemainingTime(remainingTime);
+        content += "  -- " + std::to_string(game.getCandidateCount()) +
+                   " codes still consistent with the trials -- \n";
 
         return "RST ACT STATE_" + plid + ".txt " +
                std::to_string(content.length()) + " " + content;
@@ -917,6 +2100,44 @@ std::string Server::processFinishedGame(const std::string& plid) {
     }
 }
 
+// A resent TRY whose first copy won or used up the last trial finds no
+// active game; it gets the same answer again if it matches the last trial
+// of a game finished less than RESEND_WINDOW seconds ago
+std::string Server::resendFinalTrial(const std::string& plid, const std::string& guess, int trialNum) {
+    char fname[256];
+    if (!FindLastGame(plid.c_str(), fname)) {
+        return "RTR NOK\n";
+    }
+    const char* last_underscore = strrchr(fname, '_');
+    char termination = last_underscore != nullptr ? last_underscore[1] : '\0';
+    if (termination != 'W' && termination != 'F') {
+        return "RTR NOK\n";
+    }
+
+    std::vector<std::string> lines = readGameFile(fname);
+    char secret[4][2];
+    time_t startTime;
+    int duration;
+    if (lines.size() < 3 ||
+        sscanf(lines[0].c_str(), "%*s %*s %1s %1s %1s %1s %*d %*s %*s %ld",
+               secret[0], secret[1], secret[2], secret[3], &startTime) != 5 ||
+        sscanf(lines.back().c_str(), "%*s %*s %d", &duration) != 1 ||
+        Game::currentTime() - (startTime + duration) > RESEND_WINDOW) {
+        return "RTR NOK\n";
+    }
+
+    // Trial lines are "T: C C C C nB nW seconds"
+    int trials = lines.size() - 2;
+    const std::string& lastTrial = lines[lines.size() - 2];
+    if (trials != trialNum || lastTrial.compare(0, 3 + guess.size(), "T: " + guess) != 0) {
+        return "RTR NOK\n";
+    }
+    if (termination == 'W') {
+        return "RTR OK " + std::to_string(trialNum) + " 4 0\n";
+    }
+    return "RTR ENT " + formatColors(secret[0], secret[1], secret[2], secret[3]) + "\n";
+}
+
 int Server::FindLastGame(const char* PLID, char* fname) {
     struct dirent** filelist;
     int n_entries, found;
@@ -944,118 +2165,16 @@ int Server::FindLastGame(const char* PLID, char* fname) {
 }
 
 std::string Server::handleScoreBoard() {
-    SCORELIST scores;
-    int numScores = FindTopScores(&scores);
-    
-    if (numScores == 0) {
+    rcu::ReadSection section;
+    const scoreboard::Snapshot* board = scoreBoard.current();
+    if (board->top.empty()) {
         return "RSS EMPTY\n";
     }
 
     // Create filename
     std::string fileName = "TOP_10_SCORES_" + to_string(sb_count++) + ".txt";
-
-    std::stringstream content;
-    
-    // Rest of the content formatting remains the same
-    content << "-------------------------------- TOP 10 SCORES --------------------------------\n\n"
-           << "                 SCORE PLAYER     CODE    NO TRIALS   MODE\n\n";
-
-    for (int i = 0; i < numScores; i++) {
-        content << "            " 
-                << std::right << std::setw(2) << (i + 1) << " - "
-                << std::right << std::setw(4) << scores.score[i] << "  "
-                << std::left << std::setw(10) << scores.PLID[i] << " "
-                << std::left << std::setw(8) << scores.col_code[i] << "    "
-                << std::right << std::setw(1) << scores.no_tries[i] << "       "
-                << std::left << scores.mode[i]
-                << "\n";
-    }
-    
-    content << "\n";
-    
-    std::string fileContent = content.str();
-    return "RSS OK " + fileName + " " + 
-           std::to_string(fileContent.length()) + " " + 
-           fileContent + "\n";
-}
-
-int Server::FindTopScores(SCORELIST* list) {
-    struct dirent** filelist;
-    int n_entries, i_file = 0;
-    char fname[300];
-    FILE* fp;
-    char mode[8];
-    char c1, c2, c3, c4;
-
-    // Scan SCORES directory for files
-    n_entries = scandir("Server/SCORES/", &filelist, nullptr, alphasort);
-    if (n_entries <= 0) {
-        return 0;
-    }
-
-    while (n_entries--) {
-        if (filelist[n_entries]->d_name[0] != '.' && i_file < 10) {
-            snprintf(fname, sizeof(fname), "Server/SCORES/%s", filelist[n_entries]->d_name);
-            fp = fopen(fname, "r");
-            if (fp != NULL) {
-                if (fscanf(fp, "%d %s %c %c %c %c %d %s",
-                           &list->score[i_file],
-                           list->PLID[i_file],
-                           &c1, &c2, &c3, &c4,
-                           &list->no_tries[i_file],
-                           mode) == 8) {
-                    sprintf(list->col_code[i_file], "%c%c%c%c", c1, c2, c3, c4);
-                    // Set mode based on the read value
-                    if (strcmp(mode, "PLAY") == 0) {
-                        strcpy(list->mode[i_file], "PLAY");
-                    } else if (strcmp(mode, "DEBUG") == 0) {
-                        strcpy(list->mode[i_file], "DEBUG");
-                    }
-                    i_file++;
-                }
-                fclose(fp);
-            }
-        }
-        free(filelist[n_entries]);
-    }
-    free(filelist);
-
-    list->n_scores = i_file;
-    return i_file;
+    return "RSS OK " + fileName + " " +
+           std::to_string(board->content.length()) + " " +
+           board->content + "\n";
 }
 
-int main(int argc, char* argv[]) {
-    int port = DSPORT_DEFAULT;
-    bool verbose = false;
-    
-    // Parse command line arguments
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
-            port = atoi(argv[i + 1]);
-            i++; 
-        }
-        else if (strcmp(argv[i], "-v") == 0) {
-            verbose = true;
-        }
-        else {
-            std::cerr << "Usage: " << argv[0] << " [-p GSport] [-v]" << std::endl;
-            return 1;
-        }
-    }
-
-    // Validate port number
-    if (port <= 0 || port > 65535) {
-        std::cerr << "Invalid port number. Using default port " << DSPORT_DEFAULT << std::endl;
-        port = DSPORT_DEFAULT;
-    }
-
-    try {
-        Server server(port, verbose);
-    }
-    catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
-    }
-
-    return 0;
-}
\ No newline at end of file
@@ -1,18 +1,33 @@
 #pragma once
 #include <string>
 #include <map>
+#include <deque>
+#include <list>
 #include <vector>
 #include <sstream>
 #include <netdb.h>
 #include <ctime>
 #include <unordered_set>
+#include <unordered_map>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/un.h>
+#include <fcntl.h>
 #include <cstdlib>
 #include <algorithm>
 #include <random>
+#include <memory>
+#include "solver.hpp"
+#include "capture.hpp"
+#include "game_listener.hpp"
+#include "replication.hpp"
+#include "ranking.hpp"
+#include "stats.hpp"
+#include "scoreboard.hpp"
+#include "../utils.hpp"
 
 class Game {
 private:
@@ -23,52 +38,80 @@ private:
     int maxTime;
     bool active;
     char gameMode; // 'P' for play, 'D' for debug
+    solver::CodeSet candidates; // secrets still consistent with the trials
+
+    static std::vector<GameListener*> listeners;
+    static time_t (*timeSource)();
+    static std::string (*secretSource)();
 
     // Private methods
-    void saveScoreFile() const;
-    int calculateScore() const;
+    void saveScoreFile(time_t now) const;
 
 public:
-    // Constructor
+    // New game with a random secret, saved to its game file
     Game(const std::string& pid, int maxPlayTime, char mode);
+    // Game with a known state (debug games, replicas); nothing is written
+    // until saveInitialState, trials are restored with addTrial
+    Game(const std::string& pid, int maxPlayTime, char mode,
+         const std::string& secret, time_t start);
+
+    // Listeners of the changes of every game, notified in registration order
+    static void addListener(GameListener* listener) { listeners.push_back(listener); }
+    static void removeListener(GameListener* listener) {
+        listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+    }
+
+    // Clock and secrets of every game: the wall clock and random secrets
+    // by default, replaced by GSsim to play games in virtual time
+    static void setTimeSource(time_t (*source)()) { timeSource = source; }
+    static void setSecretSource(std::string (*source)()) { secretSource = source; }
+    static time_t currentTime() { return timeSource(); }
+    static time_t systemTime() { return time(nullptr); }
+    // "R G B Y", uniformly random
+    static std::string randomSecret();
 
 
     // Methods engaging with file system
     std::string getGameFilePath() const { return "Server/GAMES/GAME_" + plid + ".txt"; };
     std::string formatTrialFileName() const { return "STATE_" + plid + ".txt"; };
     void saveInitialState() const;
-    void appendTrialToFile(const std::string& trial, int nB, int nW) const;
-    void finalizeGame(char endCode);
+    void appendTrialToFile(const std::string& trial, int nB, int nW,
+                           time_t now = currentTime()) const;
+    void finalizeGame(char endCode, time_t now = currentTime());
 
 
     // Methods engaging with game state
     void generateSecretKey();
-    bool isTimeExceeded() { return (time(nullptr) - startTime) > maxTime; };
+    bool isTimeExceeded() { return (currentTime() - startTime) > maxTime; };
     bool isActive() const { return active; }
     void setActive(bool status) { active = status; }
     void setSecretKey(const std::string& newKey) { secretKey = newKey; }
-    void addTrial(const std::string& trial) { trials.push_back(trial); }
+    void addTrial(const std::string& trial, int nB, int nW);
+    // Score of a win after seconds (of maxTime) and trials
+    static int score(int seconds, int maxTime, int trials);
+    // Game file of a game of plid finished at now: Server/GAMES/PLID/YYYYMMDD_HHMMSS_C.txt
+    static std::string finishedGamePath(const std::string& plid, char endCode, time_t now);
+    // Name of the score file of a win: SSS_PLID_DDMMYYYY_HHMMSS.txt
+    static std::string scoreFileName(int score, const std::string& plid, time_t now);
 
     // Getters
+    const std::string& getPlid() const { return plid; }
     const std::string& getSecretKey() const { return secretKey; }
     const std::vector<std::string>& getTrials() const { return trials; }
     int getTrialCount() const { return trials.size(); }
     int getMaxTime() const { return maxTime; }
+    char getGameMode() const { return gameMode; }
+    const solver::CodeSet& getCandidates() const { return candidates; }
+    int getCandidateCount() const { return candidates.count(); }
     time_t getStartTime() const { return startTime; }
 };
 
 class Server {
+    // Benchmarks and offline tools drive the handlers directly
+    friend class ServerHarness;
+
 private:    
     // Types and constants
-    typedef struct {
-        int n_scores;
-        int score[10];
-        char PLID[10][7];
-        char col_code[10][5];
-        int no_tries[10];
-        char mode[10][6]; 
-    } SCORELIST;
-
     enum GameFileStatus {
         NO_GAME = -1,          // No game file exists
         ACTIVE_GAME = 0,       // Game exists and is active (not timed out)
@@ -87,21 +130,174 @@ private:
     struct timeval timeout;
     struct addrinfo hints, *res;
     std::map<std::string, Game> activeGames;
+    // Sessions kept in memory (0 for no limit): past it the least recently
+    // used games are dropped from activeGames and restored from their game
+    // files when their players come back
+    size_t sessionBudget = 0;
+    std::list<std::string> sessionOrder;    // most recently used first
+    std::unordered_map<std::string, std::list<std::string>::iterator> sessionPos;
+    capture::Writer capture; // records traffic when open
+
+    // Game table handed over to a new GS on an upgrade (host byte order):
+    // a StateHeader, then a GameRecord and its trial codes for every active
+    // game. Codes are protocols::packCode values. From GSSTATE2 on the
+    // reply cache follows: a count, then a ReplyRecord and its request,
+    // text and response bytes for every entry.
+    struct __attribute__((packed)) StateHeader {
+        char magic[8];
+        uint32_t games;
+        uint32_t scoreboards;   // sb_count
+    };
+    struct __attribute__((packed)) GameRecord {
+        char plid[6];
+        char mode;
+        uint8_t trials;
+        uint16_t secret;
+        uint16_t maxTime;
+        int64_t startTime;
+    };
+    struct __attribute__((packed)) ReplyRecord {
+        char plid[6];
+        int64_t time;
+        uint32_t request, text, response;   // lengths
+    };
+    int upgradeFd = -1;     // Unix socket a new GS connects to (GS -U)
+    ranking::Index scoreIndex; // every win, for RNK and LDB
+    scoreboard::Board scoreBoard; // top 10, for SSB
+    stats::Store playerStats{"Server/STATS/"}; // per player totals, for PST
+
+    // Replication: changes are sent to the standby when replicator is set;
+    // a standby applies the changes read from replicaConn and only
+    // answers read requests until it is promoted (PRM)
+    std::unique_ptr<replication::Sender> replicator;
+    bool standby = false;
+    int replicaFd = -1, replicaConn = -1;
+    std::string replicaBuffer;
+    uint64_t replicaApplied = 0;    // lines and snapshots of replicaConn, acknowledged
+    int64_t replicationLagMs = 0;
+    // False from a gap in the changes (or a new connection) until the
+    // primary's snapshot is merged; PRM is refused meanwhile
+    bool replicaInSync = true;
+
+    // EXP streams: the finished games of a player are sent in chunks as
+    // the socket drains, from the select loop, so a long history neither
+    // blocks the other requests nor is held in memory. Games are kept as
+    // packed file names (YYYYMMDDHHMMSS * 256 + end code), in order.
+    struct Export {
+        std::string plid;
+        std::vector<uint64_t> games;
+        size_t next = 0;        // first game not yet read
+        std::string buffer;     // chunk being sent
+        size_t sent = 0;
+        bool finished = false;  // buffer holds the last chunk
+        time_t lastProgress;
+    };
+    std::map<int, Export> exports;          // by client socket
+    std::unique_ptr<Export> pendingExport;  // set by handleExport for run()
+    fd_set outputs, writefds;               // sockets of the exports
+
+    // Admission control: UDP requests are read into bounded queues, one per
+    // priority, and handled UDP_BATCH at a time, most urgent first. When
+    // UDP_QUEUE_LIMIT requests wait, a new one takes the place of the
+    // newest one of a lower priority, which (or else the new one) gets a
+    // BSY reply at once; STR/SSB/EXP get BSY while UDP requests wait.
+    enum Priority {
+        PRIORITY_GAME,      // TRY, QUT: games in progress
+        PRIORITY_NEW,       // SNG, DBG, BAT
+        PRIORITY_OTHER,     // HNT and anything else
+        NUM_PRIORITIES
+    };
+    struct QueuedRequest {
+        std::string message;
+        struct sockaddr_in addr;
+        socklen_t addrlen;
+        uint64_t receivedNs;    // capture time of the request, 0 when not capturing
+    };
+    std::deque<QueuedRequest> udpQueue[NUM_PRIORITIES];
+    size_t udpQueued = 0, udpQueuePeak = 0;
+
+    // Last reply to the UDP game requests (SNG/TRY/QUT/DBG) of each PLID,
+    // sent again as is when the same request bytes arrive shortly after
+    struct CachedReply {
+        std::string request;
+        std::string text;       // text form, for metrics and logs
+        std::string response;   // bytes sent (binary for binary requests)
+        time_t time;            // Game::currentTime, so it follows the games' clock
+    };
+    std::unordered_map<std::string, CachedReply> replyCache;
+    unsigned long replyCacheInserts = 0;
 
     // Setup methods
     void setupDirectory();
     void setupSockets(int port);
+    void acceptReplica();
+    void readReplica();
+    bool handOver();
+    // After a handover: finishes the exports and sends the replication
+    // backlog, for at most UPGRADE_DRAIN_TIMEOUT seconds
+    void drain();
+    std::string encodeState() const;
+    bool decodeState(const std::string& state);
+    // Games of a state, in order, without touching activeGames; end is
+    // where the games stop
+    bool decodeGames(const std::string& state, StateHeader& header, std::vector<Game>& games,
+                     size_t& end);
+    bool decodeReplies(const std::string& state, size_t& pos,
+                       std::unordered_map<std::string, CachedReply>& replies);
+    // False when the change does not follow the replicated games (a gap)
+    bool applyReplicationEvent(const replication::Event& event);
+    void applyReplicationSnapshot(const std::string& state, int64_t sentMs);
+    std::string finishedGameLines(const std::vector<replication::Finish>& finishes);
+    void serviceExports(int ready);
+    void startExport(int fd, const std::string& header);
+    bool pumpExport(int fd, Export& stream);
+    void fillExport(Export& stream);
+    void closeExport(int fd);
+    void readUDP();
+    void handleQueuedUDP(size_t max);
+    void shedRequest(const std::string& message, bool isTCP, int fd,
+                     const struct sockaddr_in* addr, socklen_t addrlen);
+    // Text command of a text or binary request ("TRY"), "" if unknown
+    static std::string commandOf(const std::string& message);
+    static Priority priorityOf(const std::string& command);
+    // "<response> BSY\n" of a command ("RTR BSY\n" for TRY)
+    static std::string busyResponse(const std::string& command);
 
     // Request handlers
     std::string handleRequest(const std::string& request, bool isTCP, 
                                 const struct sockaddr_in* client_addr);
+    std::string handleBinaryRequest(const protocols::BinaryHeader& header, bool isTCP);
+    const CachedReply* findCachedReply(const std::string& plid, const std::string& request);
+    void cacheReply(const std::string& plid, const std::string& request,
+                    const std::string& text, const std::string& response);
     std::string handleStartGame(const std::string& request);
     std::string handleTry(const std::string& request);
     std::string handleQuitExit(const std::string& request);
     std::string handleDebug(const std::string& request);
+    std::string handleHint(const std::string& request);
+    std::string handleMetrics(const struct sockaddr_in* client_addr);
+    std::string handleBatch(const std::string& request);
+    std::string handlePromote(const struct sockaddr_in* client_addr);
+    std::string handleRank(const std::string& request);
+    std::string handleLeaderboard(const std::string& request);
+    std::string handlePlayerStats(const std::string& request);
+    std::string handleExport(const std::string& request);
     std::string handleShowTrials(const std::string& request);
     std::string handleScoreBoard();
 
+    // Request logic shared by the text and binary protocols, called with
+    // the already parsed (not yet validated) arguments
+    std::string startGame(const std::string& plid, int time);
+    std::string playTrial(const std::string& plid, const std::string& c1,
+                          const std::string& c2, const std::string& c3,
+                          const std::string& c4, int trialNum);
+    std::string quitGame(const std::string& plid);
+    std::string startDebugGame(const std::string& plid, int time,
+                               const std::string& c1, const std::string& c2,
+                               const std::string& c3, const std::string& c4);
+    std::string hintGame(const std::string& plid);
+    std::string showTrials(const std::string& plid);
+
     // Game logic methods
     void countMatches(const std::string& c1, const std::string& c2,
                  const std::string& c3, const std::string& c4,
@@ -125,11 +321,40 @@ private:
     std::string processFinishedGame(const std::string& plid);
     std::vector<std::string> readGameFile(const std::string& filePath);
     std::map<std::string, Game>::iterator loadGameFromFile(const std::string& plid);
+    // activeGames with the session budget: findGame restores an evicted
+    // game, and every game found or inserted becomes the most recent
+    std::map<std::string, Game>::iterator findGame(const std::string& plid);
+    std::map<std::string, Game>::iterator insertGame(const std::string& plid, Game&& game);
+    void eraseGame(std::map<std::string, Game>::iterator it);
     int FindLastGame(const char* PLID, char* fname);
-    int FindTopScores(SCORELIST* list);
+    std::string resendFinalTrial(const std::string& plid, const std::string& guess, int trialNum);
 
 
 public:
+    // Without a port no sockets are opened; requests can only be
+    // fed through handleRequest (used by the benchmarks and tools), and
+    // the score files are only read by loadScores or takeOver
+    explicit Server(bool verboseMode);
     Server(int port, bool verboseMode);
+    ~Server();
+    // Builds the RNK/LDB index and the SSB top 10 from Server/SCORES
+    void loadScores();
+    // Records every request and response handled by run() to path
+    bool startCapture(const std::string& path) { return capture.open(path); }
+    // Streams every change of game state to the standby GS listening on
+    // standbyAddr (GS -S)
+    void startReplication(const struct sockaddr_in& standbyAddr);
+    // Zero downtime upgrades: the GS accepting upgrades on path hands its
+    // UDP/TCP sockets, active games and reply cache over to a GS calling
+    // takeOver(path) on a Server built without a port, then finishes its
+    // exports and replication backlog and returns from run()
+    bool acceptUpgrades(const std::string& path);
+    bool takeOver(const std::string& path);
+    // Runs as a standby: applies the changes a primary sends to port
+    // (loopback only) and refuses game requests until promoted
+    bool startStandby(int port);
+    // Keeps at most sessions games in memory, evicting the least recently
+    // used ones to their game files (0 for no limit)
+    void setSessionBudget(size_t sessions) { sessionBudget = sessions; }
     void run();
 };
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "solver.hpp"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace solver {
+
+    namespace {
+        std::vector<uint8_t> table;   // NUM_CODES x NUM_CODES feedback bytes
+        std::once_flag tableOnce;
+        std::atomic<int> firstMove(-1); // guess for the full candidate set
+
+        void codePegs(int index, char pegs[NUM_PEGS]) {
+            for (int i = NUM_PEGS - 1; i >= 0; i--) {
+                pegs[i] = COLORS[index % NUM_COLORS];
+                index /= NUM_COLORS;
+            }
+        }
+
+        void buildTable() {
+            table.resize(NUM_CODES * NUM_CODES);
+            char g[NUM_PEGS], s[NUM_PEGS];
+            for (int guess = 0; guess < NUM_CODES; guess++) {
+                codePegs(guess, g);
+                for (int secret = 0; secret < NUM_CODES; secret++) {
+                    codePegs(secret, s);
+                    int nB, nW;
+                    countMatches(g, s, nB, nW);
+                    table[guess * NUM_CODES + secret] = feedbackIndex(nB, nW);
+                }
+            }
+        }
+
+        struct Choice {
+            int guess;
+            int worst;
+            bool isCandidate;
+        };
+
+        // True if a is a better minimax choice than b
+        bool better(const Choice& a, const Choice& b) {
+            if (a.worst != b.worst) return a.worst < b.worst;
+            if (a.isCandidate != b.isCandidate) return a.isCandidate;
+            return a.guess < b.guess;
+        }
+
+        // Evaluates guesses [begin, end) against the candidate set. A guess
+        // is abandoned as soon as one partition exceeds the best worst case
+        // found so far by this worker.
+        Choice evaluateRange(int begin, int end,
+                             const std::vector<uint16_t>& candidates,
+                             const std::vector<char>& isCandidate) {
+            Choice best = {-1, NUM_CODES + 1, false};
+            int counts[NUM_FEEDBACKS];
+
+            for (int guess = begin; guess < end; guess++) {
+                const uint8_t* row = scoreRow(guess);
+                std::fill(counts, counts + NUM_FEEDBACKS, 0);
+                int worst = 0;
+                for (size_t i = 0; i < candidates.size(); i++) {
+                    int c = ++counts[row[candidates[i]]];
+                    if (c > worst) {
+                        worst = c;
+                        if (worst > best.worst) break;
+                    }
+                }
+                Choice choice = {guess, worst, isCandidate[guess] != 0};
+                if (better(choice, best)) best = choice;
+            }
+            return best;
+        }
+    }
+
+    void countMatches(const char guess[NUM_PEGS], const char secret[NUM_PEGS],
+                      int& nB, int& nW) {
+        bool usedGuess[NUM_PEGS] = {false};
+        bool usedSecret[NUM_PEGS] = {false};
+
+        nB = 0;
+        for (int i = 0; i < NUM_PEGS; i++) {
+            if (guess[i] == secret[i]) {
+                nB++;
+                usedGuess[i] = true;
+                usedSecret[i] = true;
+            }
+        }
+
+        nW = 0;
+        for (int i = 0; i < NUM_PEGS; i++) {
+            if (usedGuess[i]) continue;
+            for (int j = 0; j < NUM_PEGS; j++) {
+                if (!usedSecret[j] && guess[i] == secret[j]) {
+                    nW++;
+                    usedSecret[j] = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    int encodeCode(const std::string& code) {
+        int index = 0, pegs = 0;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i] == ' ') continue;
+            const char* c = std::find(COLORS, COLORS + NUM_COLORS, code[i]);
+            if (c == COLORS + NUM_COLORS || ++pegs > NUM_PEGS) return -1;
+            index = index * NUM_COLORS + (c - COLORS);
+        }
+        return pegs == NUM_PEGS ? index : -1;
+    }
+
+    std::string decodeCode(int index) {
+        char pegs[NUM_PEGS];
+        codePegs(index, pegs);
+        std::string code;
+        for (int i = 0; i < NUM_PEGS; i++) {
+            if (i > 0) code += " ";
+            code += pegs[i];
+        }
+        return code;
+    }
+
+    void init() {
+        std::call_once(tableOnce, buildTable);
+    }
+
+    const uint8_t* scoreRow(int guess) {
+        init();
+        return &table[guess * NUM_CODES];
+    }
+
+    void CodeSet::fill() {
+        for (int w = 0; w < WORDS; w++) {
+            words[w] = ~0ULL;
+        }
+        int tail = NUM_CODES % 64;
+        if (tail != 0) words[WORDS - 1] = (1ULL << tail) - 1;
+    }
+
+    int CodeSet::count() const {
+        int n = 0;
+        for (int w = 0; w < WORDS; w++) {
+            n += __builtin_popcountll(words[w]);
+        }
+        return n;
+    }
+
+    // Only words that still hold candidates are touched, so every trial
+    // costs at most one pass over a row of the feedback table, 16 bytes at
+    // a time when SSE2 is available.
+    void CodeSet::prune(int guess, int feedback) {
+        const uint8_t* row = scoreRow(guess);
+        for (int w = 0; w < WORDS; w++) {
+            if (words[w] == 0) continue;
+            int base = w * 64;
+            int n = std::min(64, NUM_CODES - base);
+            uint64_t mask = 0;
+            int b = 0;
+#ifdef __SSE2__
+            const __m128i fb = _mm_set1_epi8(static_cast<char>(feedback));
+            for (; b + 16 <= n; b += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + base + b));
+                uint64_t bits = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, fb)));
+                mask |= bits << b;
+            }
+#endif
+            for (; b < n; b++) {
+                mask |= static_cast<uint64_t>(row[base + b] == feedback) << b;
+            }
+            words[w] &= mask;
+        }
+    }
+
+    std::vector<uint16_t> CodeSet::toVector() const {
+        std::vector<uint16_t> codes;
+        codes.reserve(count());
+        for (int w = 0; w < WORDS; w++) {
+            uint64_t bits = words[w];
+            while (bits != 0) {
+                codes.push_back(w * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+        }
+        return codes;
+    }
+
+    int bestGuess(const std::vector<uint16_t>& candidates, unsigned nThreads) {
+        if (candidates.empty()) return -1;
+        if (candidates.size() <= 2) return candidates[0];
+
+        bool full = candidates.size() == static_cast<size_t>(NUM_CODES);
+        if (full && firstMove.load() >= 0) {
+            return firstMove.load();
+        }
+
+        init();
+        std::vector<char> isCandidate(NUM_CODES, 0);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            isCandidate[candidates[i]] = 1;
+        }
+
+        if (nThreads == 0) {
+            nThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        // Small sets are cheaper to solve than to hand out to threads
+        if (candidates.size() < 64) nThreads = 1;
+
+        std::vector<Choice> results(nThreads);
+        std::vector<std::thread> workers;
+        int chunk = (NUM_CODES + nThreads - 1) / nThreads;
+        for (unsigned t = 1; t < nThreads; t++) {
+            int begin = t * chunk;
+            int end = std::min(NUM_CODES, begin + chunk);
+            workers.push_back(std::thread([&results, &candidates, &isCandidate, t, begin, end]() {
+                results[t] = evaluateRange(begin, end, candidates, isCandidate);
+            }));
+        }
+        results[0] = evaluateRange(0, std::min(NUM_CODES, chunk), candidates, isCandidate);
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+
+        Choice best = results[0];
+        for (size_t i = 1; i < results.size(); i++) {
+            if (results[i].guess >= 0 && better(results[i], best)) best = results[i];
+        }
+
+        if (full) firstMove.store(best.guess);
+        return best.guess;
+    }
+}
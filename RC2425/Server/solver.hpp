@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Code arithmetic for the 4 peg / 6 color game.
+//
+// Every secret/guess is mapped to an index in [0, NUM_CODES) (base 6, first
+// peg most significant) and the feedback of a (guess, secret) pair is packed
+// in a single byte as nB * 5 + nW. The full guess x secret feedback table is
+// precomputed once so that the solver only does byte lookups.
+namespace solver {
+
+    const int NUM_PEGS = 4;
+    const int NUM_COLORS = 6;
+    const int NUM_CODES = 1296;     // NUM_COLORS ^ NUM_PEGS
+    const int NUM_FEEDBACKS = 25;   // nB * 5 + nW, nB and nW in [0, 4]
+    const int WIN_FEEDBACK = 20;    // nB = 4, nW = 0
+
+    // Colors in the same order used by Game::generateSecretKey
+    const char COLORS[NUM_COLORS] = {'R', 'G', 'B', 'Y', 'O', 'P'};
+
+    inline int feedbackIndex(int nB, int nW) { return nB * 5 + nW; }
+    inline int feedbackBlack(int feedback) { return feedback / 5; }
+    inline int feedbackWhite(int feedback) { return feedback % 5; }
+
+    // Scoring rules for one guess against one secret (pegs given as colors)
+    void countMatches(const char guess[NUM_PEGS], const char secret[NUM_PEGS],
+                      int& nB, int& nW);
+
+    // "R G B Y" -> index, -1 if the code is malformed
+    int encodeCode(const std::string& code);
+    // index -> "R G B Y"
+    std::string decodeCode(int index);
+
+    // Builds the feedback table. Called once at server startup so the first
+    // request does not pay for it; later calls are no-ops.
+    void init();
+
+    // Row of NUM_CODES feedback bytes for guess against every secret
+    const uint8_t* scoreRow(int guess);
+    inline uint8_t score(int guess, int secret) { return scoreRow(guess)[secret]; }
+
+    // Set of codes (one bit per code index) still consistent with the
+    // trials of a game
+    class CodeSet {
+    public:
+        static const int WORDS = (NUM_CODES + 63) / 64;
+
+        CodeSet() { fill(); }
+
+        void fill();
+        bool test(int code) const { return (words[code >> 6] >> (code & 63)) & 1; }
+        int count() const;
+        // Removes every code that would not give feedback against guess
+        void prune(int guess, int feedback);
+        std::vector<uint16_t> toVector() const;
+
+    private:
+        uint64_t words[WORDS];
+    };
+
+    // Knuth's minimax: the guess minimizing the largest partition of the
+    // candidate set, preferring guesses that are candidates themselves and
+    // then the lowest index. candidates must be sorted and non empty.
+    // Work is split across nThreads (0 means hardware concurrency).
+    int bestGuess(const std::vector<uint16_t>& candidates, unsigned nThreads = 0);
+}
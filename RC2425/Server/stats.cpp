@@ -0,0 +1,130 @@
+#include "stats.hpp"
+#include "server.hpp"
+#include "metrics.hpp"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <dirent.h>
+
+namespace stats {
+
+    const char END_CODES[4] = {'W', 'F', 'T', 'Q'};
+
+    namespace {
+        int endIndex(char endCode) {
+            const char* found = static_cast<const char*>(memchr(END_CODES, endCode, sizeof(END_CODES)));
+            return found ? found - END_CODES : -1;
+        }
+
+        void clear(Record& record) {
+            memset(&record, 0, sizeof(record));
+            record.bestScore = -1;
+        }
+
+        void addGame(Record& record, char endCode, int trials, int64_t seconds, int score) {
+            int end = endIndex(endCode);
+            if (end < 0) return;
+            record.games++;
+            record.ends[end]++;
+            record.totalTrials += trials;
+            record.totalSeconds += seconds > 0 ? seconds : 0;
+            if (endCode == 'W') {
+                if (trials >= 1 && trials <= MAX_ATTEMPTS) record.wins[trials]++;
+                if (score > record.bestScore) record.bestScore = score;
+            }
+        }
+    }
+
+    void Store::onScoreRecorded(const Game& game, int score, time_t now) {
+        // Called just before onGameFinalized of the same win
+        pendingScore = score;
+    }
+
+    void Store::onGameFinalized(const Game& game, char endCode, time_t now) {
+        metrics::StageTimer timer(metrics::STAGE_PERSIST);
+        bool rebuilt;
+        Record& record = find(game.getPlid(), rebuilt);
+        // A rebuilt record already counts this game, renamed to a finished
+        // game file before the listeners are called
+        if (!rebuilt) {
+            addGame(record, endCode, game.getTrialCount(), now - game.getStartTime(),
+                    endCode == 'W' ? pendingScore : -1);
+            write(game.getPlid(), record);
+        }
+        pendingScore = -1;
+    }
+
+    bool Store::get(const std::string& plid, Record& record) {
+        bool rebuilt;
+        record = find(plid, rebuilt);
+        // Only players with games are kept, so PST of every PLID (most of
+        // them never played) does not fill the map
+        if (record.games == 0) records.erase(plid);
+        return record.games > 0;
+    }
+
+    Record& Store::find(const std::string& plid, bool& rebuilt) {
+        rebuilt = false;
+        auto it = records.find(plid);
+        if (it != records.end()) return it->second;
+
+        Record& record = records[plid];
+        if (!read(plid, record)) {
+            rebuild(plid, record);
+            rebuilt = true;
+            if (record.games > 0) write(plid, record);
+        }
+        return record;
+    }
+
+    bool Store::read(const std::string& plid, Record& record) const {
+        std::ifstream file(dir + plid + ".dat", std::ios::binary);
+        return file && file.read(reinterpret_cast<char*>(&record), sizeof(record)) &&
+               file.gcount() == sizeof(record);
+    }
+
+    void Store::write(const std::string& plid, const Record& record) const {
+        std::ofstream file(dir + plid + ".dat", std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(reinterpret_cast<const char*>(&record), sizeof(record))) {
+            std::cerr << "Cannot write the statistics of " << plid << "\n";
+        }
+    }
+
+    void Store::rebuild(const std::string& plid, Record& record) const {
+        clear(record);
+        std::string playerDir = "Server/GAMES/" + plid + "/";
+        DIR* d = opendir(playerDir.c_str());
+        if (!d) return;
+
+        // Finished games: YYYYMMDD_HHMMSS_C.txt holding the header line
+        // (PLID mode C C C C maxTime date time start), the trials ("T: ...")
+        // and "date time seconds" (or "date time maxTime T")
+        struct dirent* entry;
+        while ((entry = readdir(d)) != nullptr) {
+            char endCode;
+            if (sscanf(entry->d_name, "%*8d_%*6d_%c.txt", &endCode) != 1 || endIndex(endCode) < 0) {
+                continue;
+            }
+            std::ifstream file(playerDir + entry->d_name);
+            std::string line, last;
+            int maxTime = 0, trials = 0;
+            if (!std::getline(file, line) ||
+                sscanf(line.c_str(), "%*s %*c %*c %*c %*c %*c %d", &maxTime) != 1) {
+                continue;
+            }
+            while (std::getline(file, line)) {
+                if (line.compare(0, 3, "T: ") == 0) {
+                    trials++;
+                } else if (!line.empty()) {
+                    last = line;
+                }
+            }
+            int seconds = 0;
+            sscanf(last.c_str(), "%*s %*s %d", &seconds);
+            addGame(record, endCode, trials, seconds,
+                    endCode == 'W' ? Game::score(seconds, maxTime, trials) : -1);
+        }
+        closedir(d);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+#include "game_listener.hpp"
+#include "../constant.hpp"
+
+// Per-player statistics behind the PST request.
+//
+// Every finished game updates the totals of its player in O(1) as a
+// GameListener, and the player's record is written as is to
+// Server/STATS/<PLID>.dat (a fixed size binary Record), so a PST never
+// reads the game files. The records are kept outside Server/GAMES/<PLID>/,
+// which holds only finished games. A player without a record yet (games
+// played before the GS kept statistics) gets one built once from their
+// finished game files.
+namespace stats {
+
+    struct __attribute__((packed)) Record {
+        uint32_t games;             // finished games
+        uint32_t ends[4];           // by end code, see END_CODES
+        uint32_t wins[MAX_ATTEMPTS + 1]; // wins by number of trials (index 0 unused)
+        int32_t bestScore;          // -1 without wins
+        uint64_t totalTrials;       // over all finished games
+        uint64_t totalSeconds;      // duration of all finished games
+    };
+
+    // W (win), F (no trials left), T (timeout), Q (quit)
+    extern const char END_CODES[4];
+
+    class Store : public GameListener {
+    public:
+        explicit Store(const std::string& dir) : dir(dir) {}
+
+        void onGameFinalized(const Game& game, char endCode, time_t now) override;
+        void onScoreRecorded(const Game& game, int score, time_t now) override;
+
+        // Totals of plid, false if it has no finished game
+        bool get(const std::string& plid, Record& record);
+
+    private:
+        // Record of plid, read or rebuilt (rebuilt set) the first time
+        Record& find(const std::string& plid, bool& rebuilt);
+        bool read(const std::string& plid, Record& record) const;
+        void write(const std::string& plid, const Record& record) const;
+        // Totals of the finished game files in Server/GAMES/<PLID>/
+        void rebuild(const std::string& plid, Record& record) const;
+
+        std::string dir;
+        std::unordered_map<std::string, Record> records; // players with finished games
+        int pendingScore = -1;  // score of the win being finalized
+    };
+}
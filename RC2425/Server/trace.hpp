@@ -0,0 +1,53 @@
+#pragma once
+
+// Static tracepoints (USDT) on the request lifecycle of the GS.
+//
+// Built with "make USDT=1" (needs <sys/sdt.h>, package systemtap-sdt-dev)
+// every GS_TRACE* site becomes a single nop plus an ELF note, so the probes
+// can stay in production binaries and be attached with bpftrace or perf:
+//
+//     bpftrace -e 'usdt:./GS:gs:handler__end { @[str(arg0)] = count(); }'
+//
+// Without USDT=1 the arguments only appear in unevaluated sizeof
+// expressions, so nothing is computed.
+//
+// Every probe also has a semaphore, which the tracer increments while it is
+// attached. Arguments that cost more than a load are computed only under
+// GS_TRACE_ENABLED(name), which is a constant 0 without USDT=1.
+//
+// Probes (provider "gs"):
+//   request__received  (int isTCP, size_t bytes, const char* payload)
+//   request__parsed    (const char* command, const char* plid)
+//   handler__start     (const char* command)
+//   handler__end       (const char* command, const char* response)
+//   count__matches     (int nB, int nW)
+//   game__write        (const char* plid, int kind) kind: 'S' start, 'T' trial, or end code
+//   scores__scan__start()
+//   scores__scan__end  (int entries, int scores)
+//   response__sent     (int isTCP, size_t bytes)
+
+#define GS_TRACE_PROBES(X) \
+    X(request__received) X(request__parsed) X(handler__start) X(handler__end) \
+    X(count__matches) X(game__write) X(scores__scan__start) X(scores__scan__end) \
+    X(response__sent)
+
+#ifdef GS_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+// Semaphores, defined once in server.cpp with GS_TRACE_SEMAPHORE
+#define GS_TRACE_DECLARE(name) extern unsigned short gs_##name##_semaphore;
+GS_TRACE_PROBES(GS_TRACE_DECLARE)
+#define GS_TRACE_SEMAPHORE(name) \
+    unsigned short gs_##name##_semaphore __attribute__((section(".probes"))) = 0;
+#define GS_TRACE_ENABLED(name) __builtin_expect(gs_##name##_semaphore != 0, 0)
+#define GS_TRACE0(name) DTRACE_PROBE(gs, name)
+#define GS_TRACE1(name, a) DTRACE_PROBE1(gs, name, a)
+#define GS_TRACE2(name, a, b) DTRACE_PROBE2(gs, name, a, b)
+#define GS_TRACE3(name, a, b, c) DTRACE_PROBE3(gs, name, a, b, c)
+#else
+#define GS_TRACE_ENABLED(name) 0
+#define GS_TRACE0(name) do {} while (0)
+#define GS_TRACE1(name, a) do { (void)sizeof(a); } while (0)
+#define GS_TRACE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define GS_TRACE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
@@ -0,0 +1,494 @@
+// Statistics over the whole archive of a GS data directory.
+//
+// Reads every finished game file (Server/GAMES/PLID/*.txt) and score file
+// (Server/SCORES/*.txt) and reports the games and win rate by mode, the
+// games and wins by number of trials, the first guesses, the time taken by
+// the wins (percentiles), the timeouts by maximum play time and the scores
+// by mode, as CSV (section,key,field,value) or JSON.
+//
+// Files are mapped (mmap) and parsed in place by a pool of threads with a
+// task deque each: a thread takes its newest task and, when it has none,
+// steals the oldest one of another thread. A player directory task lists
+// the directory and queues its files in batches, so a player with many
+// games is shared by the idle threads. Each thread counts into its own
+// totals, added up at the end.
+//
+// Usage: ./GSanalyze [-d datadir] [-t threads] [-f csv|json] [-o file]
+
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace {
+    const int MAX_PLAY_TIME = 600;
+    const int NUM_CODES = 1296;
+    const int MAX_SCORE = 100;
+    const size_t BATCH = 256;       // files of one task
+    const char END_CODES[4] = {'W', 'F', 'T', 'Q'};
+    const char* END_NAMES[4] = {"won", "failed", "timeout", "quit"};
+    const char* MODE_NAMES[2] = {"PLAY", "DEBUG"};
+
+    struct Stats {
+        uint64_t gameFiles = 0, scoreFiles = 0, bytes = 0, unreadable = 0;
+        uint64_t ends[2][4] = {};                    // by mode and end code
+        uint64_t games[MAX_ATTEMPTS + 1] = {};       // by number of trials
+        uint64_t wins[MAX_ATTEMPTS + 1] = {};
+        uint64_t firstGuess[NUM_CODES] = {};
+        uint64_t solveSeconds[MAX_PLAY_TIME + 1] = {}; // wins by seconds taken
+        uint64_t maxTimeGames[MAX_PLAY_TIME + 1] = {};
+        uint64_t maxTimeTimeouts[MAX_PLAY_TIME + 1] = {};
+        uint64_t scores[2][MAX_SCORE + 1] = {};
+
+        void add(const Stats& o) {
+            gameFiles += o.gameFiles;
+            scoreFiles += o.scoreFiles;
+            bytes += o.bytes;
+            unreadable += o.unreadable;
+            for (int m = 0; m < 2; m++) {
+                for (int e = 0; e < 4; e++) ends[m][e] += o.ends[m][e];
+                for (int s = 0; s <= MAX_SCORE; s++) scores[m][s] += o.scores[m][s];
+            }
+            for (int t = 0; t <= MAX_ATTEMPTS; t++) {
+                games[t] += o.games[t];
+                wins[t] += o.wins[t];
+            }
+            for (int c = 0; c < NUM_CODES; c++) firstGuess[c] += o.firstGuess[c];
+            for (int s = 0; s <= MAX_PLAY_TIME; s++) {
+                solveSeconds[s] += o.solveSeconds[s];
+                maxTimeGames[s] += o.maxTimeGames[s];
+                maxTimeTimeouts[s] += o.maxTimeTimeouts[s];
+            }
+        }
+    };
+
+    // Work stealing pool: tasks may queue more tasks on their own thread
+    class Pool {
+    public:
+        typedef std::function<void(int worker)> Task;
+
+        explicit Pool(unsigned threads) : queues(threads), pending(0) {}
+
+        void push(int worker, Task task) {
+            pending++;
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            queues[worker].tasks.push_back(std::move(task));
+        }
+
+        // Runs the queued tasks (and the tasks they queue) to the end
+        void run() {
+            std::vector<std::thread> threads;
+            for (size_t w = 0; w < queues.size(); w++) {
+                threads.push_back(std::thread(&Pool::work, this, (int)w));
+            }
+            for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+        }
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        bool take(int worker, Task& task) {
+            {
+                Queue& own = queues[worker];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tasks.empty()) {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < queues.size(); i++) {
+                Queue& other = queues[(worker + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(other.mutex);
+                if (!other.tasks.empty()) {
+                    task = std::move(other.tasks.front());
+                    other.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(int worker) {
+            Task task;
+            while (pending.load() > 0) {
+                if (take(worker, task)) {
+                    task(worker);
+                    pending--;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        std::vector<Queue> queues;
+        std::atomic<long> pending;  // queued or running tasks
+    };
+
+    // Contents of a file, mapped for reading
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) : data(nullptr), size(0) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    data = static_cast<const char*>(p);
+                    size = st.st_size;
+                }
+            }
+            close(fd);
+        }
+        ~MappedFile() {
+            if (data) munmap(const_cast<char*>(data), size);
+        }
+
+        const char* data;
+        size_t size;
+    };
+
+    // Next line of [pos, end) copied to line (truncated), false at the end
+    bool nextLine(const char*& pos, const char* end, char* line, size_t max) {
+        if (pos >= end) return false;
+        const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if (!eol) eol = end;
+        size_t n = std::min((size_t)(eol - pos), max - 1);
+        memcpy(line, pos, n);
+        line[n] = '\0';
+        pos = eol + 1;
+        return true;
+    }
+
+    int endIndex(char endCode) {
+        for (int e = 0; e < 4; e++) {
+            if (END_CODES[e] == endCode) return e;
+        }
+        return -1;
+    }
+
+    // Finished game file: header (PLID mode C C C C maxTime date time start),
+    // "T: C C C C nB nW s" per trial, then "date time seconds"
+    // (or "date time maxTime T")
+    void parseGame(const std::string& path, char endCode, Stats& stats) {
+        MappedFile file(path);
+        int end = endIndex(endCode);
+        if (!file.data || end < 0) {
+            stats.unreadable++;
+            return;
+        }
+        const char* pos = file.data;
+        const char* last = file.data + file.size;
+        char line[128], mode;
+        int maxTime;
+        if (!nextLine(pos, last, line, sizeof(line)) ||
+            sscanf(line, "%*s %c %*c %*c %*c %*c %d", &mode, &maxTime) != 2) {
+            stats.unreadable++;
+            return;
+        }
+        stats.gameFiles++;
+        stats.bytes += file.size;
+
+        int trials = 0, seconds = -1;
+        while (nextLine(pos, last, line, sizeof(line))) {
+            if (strncmp(line, "T: ", 3) == 0) {
+                if (trials++ == 0 && strlen(line) >= 10) {
+                    uint16_t code = protocols::packCode(std::string(line + 3, 7));
+                    if (code < NUM_CODES) stats.firstGuess[code]++;
+                }
+            } else if (line[0] != '\0') {
+                sscanf(line, "%*s %*s %d", &seconds);
+            }
+        }
+
+        stats.ends[mode == 'D' ? 1 : 0][end]++;
+        trials = std::min(trials, MAX_ATTEMPTS);
+        stats.games[trials]++;
+        if (endCode == 'W') {
+            stats.wins[trials]++;
+            if (seconds >= 0) stats.solveSeconds[std::min(seconds, MAX_PLAY_TIME)]++;
+        }
+        if (maxTime > 0 && maxTime <= MAX_PLAY_TIME) {
+            stats.maxTimeGames[maxTime]++;
+            if (endCode == 'T') stats.maxTimeTimeouts[maxTime]++;
+        }
+    }
+
+    // Score file: "SSS PLID C C C C N MODE"
+    void parseScore(const std::string& path, Stats& stats) {
+        MappedFile file(path);
+        const char* pos = file.data;
+        char line[128], mode[8];
+        int score;
+        if (!file.data || !nextLine(pos, file.data + file.size, line, sizeof(line)) ||
+            sscanf(line, "%d %*s %*c %*c %*c %*c %*d %7s", &score, mode) != 2 ||
+            score < 0 || score > MAX_SCORE) {
+            stats.unreadable++;
+            return;
+        }
+        stats.scoreFiles++;
+        stats.bytes += file.size;
+        stats.scores[strcmp(mode, "DEBUG") == 0 ? 1 : 0][score]++;
+    }
+
+    // Queues the finished games of a player directory in batches
+    void scanPlayer(Pool& pool, std::vector<Stats>& stats, const std::string& dir, int worker) {
+        DIR* d = opendir(dir.c_str());
+        if (!d) return;
+        std::vector<std::string> batch;
+        struct dirent* entry;
+        char endCode;
+        while (true) {
+            entry = readdir(d);
+            if (entry && sscanf(entry->d_name, "%*8d_%*6d_%c.txt", &endCode) == 1) {
+                batch.push_back(entry->d_name);
+            }
+            if (batch.size() == BATCH || (!entry && !batch.empty())) {
+                pool.push(worker, [&pool, &stats, dir, batch](int w) {
+                    for (size_t i = 0; i < batch.size(); i++) {
+                        const std::string& name = batch[i];
+                        parseGame(dir + name, name[name.size() - 5], stats[w]);
+                    }
+                });
+                batch.clear();
+            }
+            if (!entry) break;
+        }
+        closedir(d);
+    }
+
+    uint64_t sum(const uint64_t* values, int n) {
+        uint64_t total = 0;
+        for (int i = 0; i < n; i++) total += values[i];
+        return total;
+    }
+
+    // Smallest value with at least a fraction p of the counts at or below it
+    int percentile(const uint64_t* counts, int n, double p) {
+        uint64_t total = sum(counts, n), seen = 0;
+        if (total == 0) return 0;
+        for (int i = 0; i < n; i++) {
+            seen += counts[i];
+            if (seen >= p * total) return i;
+        }
+        return n - 1;
+    }
+
+    double mean(const uint64_t* counts, int n) {
+        uint64_t total = sum(counts, n);
+        double weighted = 0;
+        for (int i = 0; i < n; i++) weighted += (double)i * counts[i];
+        return total ? weighted / total : 0;
+    }
+
+    int highest(const uint64_t* counts, int n) {
+        for (int i = n - 1; i >= 0; i--) {
+            if (counts[i]) return i;
+        }
+        return 0;
+    }
+
+    double ratio(uint64_t a, uint64_t b) { return b ? (double)a / b : 0; }
+
+    // One (section, key, field, value) row of the report
+    struct Row {
+        std::string section, key, field, value;
+    };
+
+    std::string number(double value) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.4f", value);
+        return buf;
+    }
+
+    std::vector<Row> report(const Stats& s) {
+        std::vector<Row> rows;
+        auto add = [&rows](const std::string& section, const std::string& key,
+                           const std::string& field, const std::string& value) {
+            rows.push_back(Row{section, key, field, value});
+        };
+
+        add("files", "all", "games", std::to_string(s.gameFiles));
+        add("files", "all", "scores", std::to_string(s.scoreFiles));
+        add("files", "all", "bytes", std::to_string(s.bytes));
+        add("files", "all", "unreadable", std::to_string(s.unreadable));
+
+        for (int m = 0; m < 2; m++) {
+            uint64_t games = sum(s.ends[m], 4);
+            add("mode", MODE_NAMES[m], "games", std::to_string(games));
+            for (int e = 0; e < 4; e++) add("mode", MODE_NAMES[m], END_NAMES[e], std::to_string(s.ends[m][e]));
+            add("mode", MODE_NAMES[m], "win_rate", number(ratio(s.ends[m][0], games)));
+        }
+
+        for (int t = 0; t <= MAX_ATTEMPTS; t++) {
+            add("trials", std::to_string(t), "games", std::to_string(s.games[t]));
+            add("trials", std::to_string(t), "wins", std::to_string(s.wins[t]));
+        }
+
+        std::vector<int> codes;
+        for (int c = 0; c < NUM_CODES; c++) {
+            if (s.firstGuess[c]) codes.push_back(c);
+        }
+        std::sort(codes.begin(), codes.end(), [&s](int a, int b) {
+            return s.firstGuess[a] != s.firstGuess[b] ? s.firstGuess[a] > s.firstGuess[b] : a < b;
+        });
+        for (size_t i = 0; i < codes.size(); i++) {
+            std::string code = protocols::unpackCode(codes[i]);
+            code.erase(std::remove(code.begin(), code.end(), ' '), code.end());
+            add("first_guess", code, "games", std::to_string(s.firstGuess[codes[i]]));
+        }
+
+        const int n = MAX_PLAY_TIME + 1;
+        add("solve_seconds", "W", "count", std::to_string(sum(s.solveSeconds, n)));
+        add("solve_seconds", "W", "mean", number(mean(s.solveSeconds, n)));
+        add("solve_seconds", "W", "p50", std::to_string(percentile(s.solveSeconds, n, 0.50)));
+        add("solve_seconds", "W", "p90", std::to_string(percentile(s.solveSeconds, n, 0.90)));
+        add("solve_seconds", "W", "p99", std::to_string(percentile(s.solveSeconds, n, 0.99)));
+        add("solve_seconds", "W", "max", std::to_string(highest(s.solveSeconds, n)));
+
+        for (int t = 1; t <= MAX_PLAY_TIME; t++) {
+            if (!s.maxTimeGames[t]) continue;
+            add("max_time", std::to_string(t), "games", std::to_string(s.maxTimeGames[t]));
+            add("max_time", std::to_string(t), "timeouts", std::to_string(s.maxTimeTimeouts[t]));
+            add("max_time", std::to_string(t), "timeout_rate",
+                number(ratio(s.maxTimeTimeouts[t], s.maxTimeGames[t])));
+        }
+
+        for (int m = 0; m < 2; m++) {
+            const uint64_t* scores = s.scores[m];
+            add("score", MODE_NAMES[m], "count", std::to_string(sum(scores, MAX_SCORE + 1)));
+            add("score", MODE_NAMES[m], "mean", number(mean(scores, MAX_SCORE + 1)));
+            add("score", MODE_NAMES[m], "p50", std::to_string(percentile(scores, MAX_SCORE + 1, 0.50)));
+            add("score", MODE_NAMES[m], "p90", std::to_string(percentile(scores, MAX_SCORE + 1, 0.90)));
+            add("score", MODE_NAMES[m], "max", std::to_string(highest(scores, MAX_SCORE + 1)));
+        }
+        return rows;
+    }
+
+    void writeCSV(FILE* out, const std::vector<Row>& rows) {
+        fprintf(out, "section,key,field,value\n");
+        for (size_t i = 0; i < rows.size(); i++) {
+            fprintf(out, "%s,%s,%s,%s\n", rows[i].section.c_str(), rows[i].key.c_str(),
+                    rows[i].field.c_str(), rows[i].value.c_str());
+        }
+    }
+
+    // {"section": {"key": {"field": value, ...}, ...}, ...} in report order
+    void writeJSON(FILE* out, const std::vector<Row>& rows) {
+        fprintf(out, "{");
+        for (size_t i = 0; i < rows.size(); i++) {
+            const Row& r = rows[i];
+            bool newSection = i == 0 || rows[i - 1].section != r.section;
+            bool newKey = newSection || rows[i - 1].key != r.key;
+            if (newSection) {
+                fprintf(out, "%s\n  \"%s\": {", i ? "}}," : "", r.section.c_str());
+            }
+            if (newKey) {
+                fprintf(out, "%s\n    \"%s\": {", newSection ? "" : "},", r.key.c_str());
+            } else {
+                fprintf(out, ", ");
+            }
+            fprintf(out, "\"%s\": %s", r.field.c_str(), r.value.c_str());
+        }
+        fprintf(out, "%s\n}\n", rows.empty() ? "" : "}}");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned nThreads = std::thread::hardware_concurrency();
+    std::string dataDir = ".", format = "csv", path;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            nThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-d datadir] [-t threads] [-f csv|json] [-o file]" << std::endl;
+            return 1;
+        }
+    }
+    if (format != "csv" && format != "json") {
+        std::cerr << "Unknown format " << format << std::endl;
+        return 1;
+    }
+    if (nThreads == 0) nThreads = 1;
+    auto start = std::chrono::steady_clock::now();
+
+    Pool pool(nThreads);
+    std::vector<Stats> stats(nThreads);
+    unsigned next = 0;
+
+    // Player directories, spread over the threads
+    std::string gamesDir = dataDir + "/Server/GAMES/";
+    DIR* d = opendir(gamesDir.c_str());
+    if (!d) {
+        std::cerr << "Cannot open " << gamesDir << std::endl;
+        return 1;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        if (entry->d_name[0] == '.' || strncmp(entry->d_name, "GAME_", 5) == 0) continue;
+        std::string dir = gamesDir + entry->d_name + "/";
+        pool.push(next++ % nThreads, [&pool, &stats, dir](int w) { scanPlayer(pool, stats, dir, w); });
+    }
+    closedir(d);
+
+    // Score files, in batches
+    std::string scoresDir = dataDir + "/Server/SCORES/";
+    d = opendir(scoresDir.c_str());
+    if (d) {
+        std::vector<std::string> batch;
+        while (true) {
+            entry = readdir(d);
+            if (entry && entry->d_name[0] != '.') batch.push_back(scoresDir + entry->d_name);
+            if (batch.size() == BATCH || (!entry && !batch.empty())) {
+                pool.push(next++ % nThreads, [&stats, batch](int w) {
+                    for (size_t i = 0; i < batch.size(); i++) parseScore(batch[i], stats[w]);
+                });
+                batch.clear();
+            }
+            if (!entry) break;
+        }
+        closedir(d);
+    }
+
+    pool.run();
+    Stats total;
+    for (size_t t = 0; t < stats.size(); t++) total.add(stats[t]);
+
+    FILE* out = path.empty() ? stdout : fopen(path.c_str(), "w");
+    if (!out) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return 1;
+    }
+    std::vector<Row> rows = report(total);
+    if (format == "json") {
+        writeJSON(out, rows);
+    } else {
+        writeCSV(out, rows);
+    }
+    if (out != stdout) fclose(out);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "Read %llu game and %llu score files (%llu bytes) with %u threads in %.2fs\n",
+            (unsigned long long)total.gameFiles, (unsigned long long)total.scoreFiles,
+            (unsigned long long)total.bytes, nThreads, elapsed.count());
+    return 0;
+}
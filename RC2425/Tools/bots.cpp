@@ -0,0 +1,184 @@
+// Plays many concurrent games against a running GS from one thread.
+//
+// Every bot starts a game, then asks the GS for a hint (HNT) and plays it
+// until the code is guessed or the trials run out, all through the
+// non-blocking SessionClient. With -t the guesses come from a strategy
+// table (GSstrategy) instead, which costs the GS no solver work. PLIDs are
+// consecutive from the first one, so bots of different runs should use
+// different ranges.
+//
+// Usage: ./GSbots [-n GSIP] [-p GSport] [-s sessions] [-k sockets] [-f firstPLID] [-t table] [-j]
+
+#include "../Client/session_client.hpp"
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include "../strategy.hpp"
+#include <memory>
+
+namespace {
+    struct Bot {
+        uint32_t plid;
+        int nT;
+        int64_t node;   // strategy table node of the next guess
+        bool done;
+    };
+
+    struct Summary {
+        long requests = 0;
+        long won = 0;
+        long lost = 0;
+        long failed = 0;
+        long trials[MAX_ATTEMPTS + 1] = {0}; // games won per number of trials
+    };
+
+    class Fleet {
+    public:
+        Fleet(SessionClient& client, const strategy::Table& table, std::vector<Bot>& bots,
+              Summary& summary)
+            : client(client), table(table), bots(bots), summary(summary) {}
+
+        void start(size_t i) {
+            summary.requests++;
+            client.startGame(bots[i].plid, 600, [this, i](const SessionClient::Reply& reply) {
+                if (reply.timedOut || reply.status != protocols::BS_OK) return fail(i, reply);
+                next(i);
+            });
+        }
+
+    private:
+        void next(size_t i) {
+            if (!table.isOpen()) return askHint(i);
+            if (bots[i].node < 0) {
+                std::cerr << "PLID " << bots[i].plid << ": feedback not in the strategy table\n";
+                summary.failed++;
+                bots[i].done = true;
+                return;
+            }
+            play(i, table.guess(bots[i].node));
+        }
+
+        void askHint(size_t i) {
+            summary.requests++;
+            client.hint(bots[i].plid, [this, i](const SessionClient::Reply& reply) {
+                if (reply.timedOut || reply.status != protocols::BS_OK) return fail(i, reply);
+                play(i, reply.colors);
+            });
+        }
+
+        void play(size_t i, const std::string& colors) {
+            summary.requests++;
+            client.tryCode(bots[i].plid, colors, ++bots[i].nT, [this, i](const SessionClient::Reply& reply) {
+                if (reply.timedOut) return fail(i, reply);
+                if (reply.status == protocols::BS_OK && reply.nB == 4) {
+                    summary.won++;
+                    summary.trials[bots[i].nT]++;
+                    bots[i].done = true;
+                } else if (reply.status == protocols::BS_OK) {
+                    if (table.isOpen()) bots[i].node = table.next(bots[i].node, reply.nB, reply.nW);
+                    next(i);
+                } else if (reply.status == protocols::BS_ENT) {
+                    summary.lost++;
+                    bots[i].done = true;
+                } else {
+                    fail(i, reply);
+                }
+            });
+        }
+
+        void fail(size_t i, const SessionClient::Reply& reply) {
+            summary.failed++;
+            bots[i].done = true;
+            std::cerr << "PLID " << bots[i].plid << ": "
+                      << (reply.timedOut ? "timed out\n" : reply.text);
+        }
+
+        SessionClient& client;
+        const strategy::Table& table;
+        std::vector<Bot>& bots;
+        Summary& summary;
+    };
+}
+
+int main(int argc, char* argv[]) {
+    std::string serverIP = DSIP_DEFAULT;
+    int serverPort = DSPORT_DEFAULT;
+    int sessions = 100, nSockets = 1;
+    uint32_t firstPlid = 500000;
+    bool json = false;
+    std::string tablePath;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            serverIP = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            serverPort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sessions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            nSockets = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            firstPlid = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tablePath = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            json = true;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [-n GSIP] [-p GSport] [-s sessions] [-k sockets] [-f firstPLID] [-t table] [-j]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (sessions <= 0 || firstPlid + sessions > 1000000) {
+        std::cerr << "PLIDs must stay below 1000000\n";
+        return 1;
+    }
+
+    strategy::Table table;
+    if (!tablePath.empty() && !table.open(tablePath)) return 1;
+
+    std::unique_ptr<SessionClient> connection;
+    try {
+        connection.reset(new SessionClient(serverIP, serverPort, nSockets));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    SessionClient& client = *connection;
+    std::vector<Bot> bots(sessions);
+    Summary summary;
+    Fleet fleet(client, table, bots, summary);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < sessions; i++) {
+        bots[i].plid = firstPlid + i;
+        bots[i].nT = 0;
+        bots[i].node = 0;
+        bots[i].done = false;
+        fleet.start(i);
+    }
+    client.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double rate = summary.requests / elapsed.count();
+    if (json) {
+        fprintf(stdout, "{\"sessions\":%d,\"won\":%ld,\"lost\":%ld,\"failed\":%ld,\"requests\":%ld,"
+                "\"seconds\":%.3f,\"requests_per_second\":%.0f,\"won_by_trials\":[",
+                sessions, summary.won, summary.lost, summary.failed, summary.requests,
+                elapsed.count(), rate);
+        for (int t = 1; t <= MAX_ATTEMPTS; t++) {
+            fprintf(stdout, "%ld%s", summary.trials[t], t < MAX_ATTEMPTS ? "," : "]}\n");
+        }
+    } else {
+        fprintf(stdout, "Sessions: %d  Won: %ld  Lost: %ld  Failed: %ld\n",
+                sessions, summary.won, summary.lost, summary.failed);
+        fprintf(stdout, "Requests: %ld  Time: %.3fs  (%.0f requests/s)\n",
+                summary.requests, elapsed.count(), rate);
+        fprintf(stdout, "Won by number of trials:");
+        for (int t = 1; t <= MAX_ATTEMPTS; t++) {
+            fprintf(stdout, " %d:%ld", t, summary.trials[t]);
+        }
+        fprintf(stdout, "\n");
+    }
+    return summary.failed == 0 ? 0 : 2;
+}
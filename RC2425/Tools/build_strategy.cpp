@@ -0,0 +1,274 @@
+// Builds a strategy table for the player's autoplay command and GSbots.
+//
+// The tree minimizes the total number of trials over all 1296 secrets
+// (that is, the expected number of trials). Candidate sets of up to -e codes
+// are solved exactly by branch and bound over every guess. Larger sets try
+// the -k best guesses by number of feedback classes (then candidates, then
+// smallest largest class) and keep the one whose subtree is cheapest. The
+// first guesses (one per class of equivalent codes) and their feedback
+// subtrees are built in parallel. Feedback comes from the solver's table,
+// which follows the same scoring rules as the GS.
+//
+// Usage: ./GSstrategy [-t threads] [-k lookahead] [-e exactLimit] [-o file]
+
+#include "../Server/solver.hpp"
+#include "../strategy.hpp"
+#include <iostream>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+    typedef std::vector<uint16_t> Codes;
+
+    struct TreeNode {
+        int guess;
+        long total;     // trials summed over the secrets that reach this node
+        int depth;      // trials of the deepest secret below, this guess included
+        std::unique_ptr<TreeNode> children[solver::NUM_FEEDBACKS];
+    };
+
+    int lookahead = 5;
+    size_t exactLimit = 15;
+
+    // Splits set by the feedback to guess
+    void partition(int guess, const Codes& set, Codes parts[solver::NUM_FEEDBACKS]) {
+        const uint8_t* row = solver::scoreRow(guess);
+        for (int f = 0; f < solver::NUM_FEEDBACKS; f++) parts[f].clear();
+        for (size_t i = 0; i < set.size(); i++) {
+            parts[row[set[i]]].push_back(set[i]);
+        }
+    }
+
+    std::unique_ptr<TreeNode> build(const Codes& set);
+
+    // Node for guess, with the subtree of every feedback that needs more trials
+    std::unique_ptr<TreeNode> expand(int guess, const Codes& set) {
+        std::unique_ptr<TreeNode> node(new TreeNode());
+        node->guess = guess;
+        node->total = set.size();
+        node->depth = 1;
+        Codes parts[solver::NUM_FEEDBACKS];
+        partition(guess, set, parts);
+        for (int f = 0; f < solver::NUM_FEEDBACKS; f++) {
+            if (f == solver::WIN_FEEDBACK || parts[f].empty()) continue;
+            node->children[f] = build(parts[f]);
+            node->total += node->children[f]->total;
+            node->depth = std::max(node->depth, node->children[f]->depth + 1);
+        }
+        return node;
+    }
+
+    // Lowest total for set below bound, bound if there is none
+    long exactCost(const Codes& set, long bound, int* bestGuess);
+
+    long partCost(const Codes& part, long bound) {
+        if (part.size() == 1) return 1;
+        if (part.size() == 2) return 3;
+        return exactCost(part, bound, nullptr);
+    }
+
+    long exactCost(const Codes& set, long bound, int* bestGuess) {
+        long n = set.size();
+        std::vector<std::pair<long, int>> order; // (lower bound, guess)
+        order.reserve(solver::NUM_CODES);
+        for (int g = 0; g < solver::NUM_CODES; g++) {
+            const uint8_t* row = solver::scoreRow(g);
+            int sizes[solver::NUM_FEEDBACKS] = {0};
+            for (long i = 0; i < n; i++) sizes[row[set[i]]]++;
+
+            // Every secret not guessed now needs one more trial, and all
+            // but one of a class need two
+            long lower = n;
+            bool useless = false;
+            for (int f = 0; f < solver::NUM_FEEDBACKS; f++) {
+                if (f == solver::WIN_FEEDBACK || sizes[f] == 0) continue;
+                if (sizes[f] == n) useless = true;
+                lower += sizes[f] == 1 ? 1 : 2 * sizes[f] - 1;
+            }
+            if (!useless && lower < bound) order.push_back(std::make_pair(lower, g));
+        }
+        std::sort(order.begin(), order.end());
+
+        long best = bound;
+        Codes parts[solver::NUM_FEEDBACKS];
+        for (size_t i = 0; i < order.size() && order[i].first < best; i++) {
+            partition(order[i].second, set, parts);
+            long total = n, lower = order[i].first - n; // of the classes not solved yet
+            for (int f = 0; f < solver::NUM_FEEDBACKS && total < best; f++) {
+                if (f == solver::WIN_FEEDBACK || parts[f].empty()) continue;
+                long partLower = parts[f].size() == 1 ? 1 : 2 * parts[f].size() - 1;
+                lower -= partLower;
+                total += partCost(parts[f], best - total - lower);
+            }
+            if (total < best) {
+                best = total;
+                if (bestGuess) *bestGuess = order[i].second;
+            }
+        }
+        return best;
+    }
+
+    // Guesses by number of feedback classes, then candidates first, then
+    // smallest largest class
+    std::vector<int> rankGuesses(const Codes& set) {
+        std::vector<bool> isCandidate(solver::NUM_CODES, false);
+        for (size_t i = 0; i < set.size(); i++) isCandidate[set[i]] = true;
+
+        std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> ranked;
+        for (int g = 0; g < solver::NUM_CODES; g++) {
+            const uint8_t* row = solver::scoreRow(g);
+            int sizes[solver::NUM_FEEDBACKS] = {0};
+            for (size_t i = 0; i < set.size(); i++) sizes[row[set[i]]]++;
+            int classes = 0, largest = 0;
+            for (int f = 0; f < solver::NUM_FEEDBACKS; f++) {
+                if (sizes[f] > 0) classes++;
+                largest = std::max(largest, sizes[f]);
+            }
+            ranked.push_back(std::make_pair(std::make_pair(-classes, isCandidate[g] ? 0 : 1),
+                                            std::make_pair(largest, g)));
+        }
+        std::sort(ranked.begin(), ranked.end());
+
+        std::vector<int> guesses;
+        for (size_t i = 0; i < ranked.size() && (int)guesses.size() < lookahead; i++) {
+            guesses.push_back(ranked[i].second.second);
+        }
+        return guesses;
+    }
+
+    std::unique_ptr<TreeNode> build(const Codes& set) {
+        if (set.size() <= exactLimit) {
+            int guess = set[0];
+            if (set.size() > 1) exactCost(set, 1L << 40, &guess);
+            return expand(guess, set);
+        }
+        std::unique_ptr<TreeNode> best;
+        std::vector<int> guesses = rankGuesses(set);
+        for (size_t i = 0; i < guesses.size(); i++) {
+            std::unique_ptr<TreeNode> node = expand(guesses[i], set);
+            if (!best || node->total < best->total) best = std::move(node);
+        }
+        return best;
+    }
+
+    // Flattens the tree breadth first so the children of a node are contiguous
+    void flatten(const TreeNode* root, std::vector<strategy::Node>& nodes) {
+        std::vector<const TreeNode*> queue(1, root);
+        nodes.clear();
+        nodes.resize(1);
+        for (size_t i = 0; i < queue.size(); i++) {
+            const TreeNode* t = queue[i];
+            strategy::Node n;
+            n.guess = t->guess;
+            n.reserved = 0;
+            n.firstChild = queue.size();
+            n.childMask = 0;
+            for (int f = 0; f < solver::NUM_FEEDBACKS; f++) {
+                if (!t->children[f]) continue;
+                n.childMask |= 1u << f;
+                queue.push_back(t->children[f].get());
+            }
+            nodes[i] = n;
+            nodes.resize(queue.size());
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned nThreads = std::thread::hardware_concurrency();
+    std::string path = strategy::DEFAULT_FILE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            nThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            lookahead = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            exactLimit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-t threads] [-k lookahead] [-e exactLimit] [-o file]" << std::endl;
+            return 1;
+        }
+    }
+    if (nThreads == 0) nThreads = 1;
+    if (lookahead < 1) lookahead = 1;
+
+    solver::init();
+    auto start = std::chrono::steady_clock::now();
+
+    Codes all(solver::NUM_CODES);
+    for (int i = 0; i < solver::NUM_CODES; i++) all[i] = i;
+
+    // One first guess per class of equivalent codes: RRRR RRRG RRGG RRGB RGBY
+    const char* firsts[] = {"R R R R", "R R R G", "R R G G", "R R G B", "R G B Y"};
+    const int NUM_FIRSTS = 5;
+
+    struct Task {
+        int first;
+        int feedback;
+        Codes set;
+        std::unique_ptr<TreeNode> tree;
+    };
+    std::vector<Task> tasks;
+    for (int i = 0; i < NUM_FIRSTS; i++) {
+        Codes parts[solver::NUM_FEEDBACKS];
+        partition(solver::encodeCode(firsts[i]), all, parts);
+        for (int f = 0; f < solver::NUM_FEEDBACKS; f++) {
+            if (f == solver::WIN_FEEDBACK || parts[f].empty()) continue;
+            Task task;
+            task.first = i;
+            task.feedback = f;
+            task.set = parts[f];
+            tasks.push_back(std::move(task));
+        }
+    }
+    // Largest subtrees first so no thread is left with a big one at the end
+    std::sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) {
+        return a.set.size() > b.set.size();
+    });
+
+    std::atomic<size_t> nextTask(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.push_back(std::thread([&]() {
+            for (size_t i = nextTask++; i < tasks.size(); i = nextTask++) {
+                tasks[i].tree = build(tasks[i].set);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    std::unique_ptr<TreeNode> best;
+    for (int i = 0; i < NUM_FIRSTS; i++) {
+        std::unique_ptr<TreeNode> root(new TreeNode());
+        root->guess = solver::encodeCode(firsts[i]);
+        root->total = solver::NUM_CODES;
+        root->depth = 1;
+        for (size_t t = 0; t < tasks.size(); t++) {
+            if (tasks[t].first != i) continue;
+            root->total += tasks[t].tree->total;
+            root->depth = std::max(root->depth, tasks[t].tree->depth + 1);
+            root->children[tasks[t].feedback] = std::move(tasks[t].tree);
+        }
+        fprintf(stdout, "First guess %s: %.4f trials on average, at most %d\n", firsts[i],
+                (double)root->total / solver::NUM_CODES, root->depth);
+        if (!best || root->total < best->total) best = std::move(root);
+    }
+
+    std::vector<strategy::Node> nodes;
+    flatten(best.get(), nodes);
+    if (!strategy::write(path, nodes, best->depth, best->total)) return 1;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fprintf(stdout, "Wrote %s: first guess %s, %.4f trials on average (%ld total), at most %d, "
+            "%zu nodes, %.1fs\n", path.c_str(), solver::decodeCode(best->guess).c_str(),
+            (double)best->total / solver::NUM_CODES, best->total, best->depth, nodes.size(),
+            elapsed.count());
+    return best->depth <= 8 ? 0 : 2;
+}
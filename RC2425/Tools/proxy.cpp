@@ -0,0 +1,767 @@
+// Spreads the players over several GS processes, routing by PLID.
+//
+// Listens on the GS port (UDP and TCP) and forwards every request to the
+// backend GS that owns its PLID on a consistent hash ring, so adding or
+// removing a backend only moves the players of the ring segments it
+// gains or loses. Each backend runs from its own data directory (GS -d).
+// PLIDs are read from text and binary requests alike; requests without
+// one go to the owner of PLID 0, which answers them as any GS would.
+//
+// UDP clients get one upstream socket each, so a backend always sees the
+// same endpoint for a client and its reply cache keeps answering
+// retransmissions. A BAT whose requests belong to several backends is
+// split into one sub-batch per backend and the replies are put back in
+// request order. TCP connections are served by a thread each: STR goes to
+// the owner of the PLID, SSB merges the top 10 of every backend, LDB
+// merges the boards of every backend and RNK adds up the wins of every
+// backend better than the player's best, and MTR (loopback clients only)
+// returns the metrics of every backend.
+//
+// Usage: ./GSproxy [-p GSport] [-v] -b host:port [-b host:port ...]
+
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ctime>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <iomanip>
+#include <algorithm>
+
+namespace {
+    const int VIRTUAL_NODES = 160;  // ring points per backend
+    const int UPSTREAM_IDLE = 60;   // seconds before an idle client's upstream socket is closed
+
+    struct Backend {
+        std::string name;           // host:port
+        struct sockaddr_in addr;
+    };
+
+    std::vector<Backend> backends;
+    bool verbose = false;
+    std::atomic<int> scoreboardCount(1);
+
+    // Murmur3 finalizer: spreads consecutive PLIDs over the whole ring
+    uint32_t mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // FNV-1a
+    uint32_t hashName(const std::string& name) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < name.size(); i++) {
+            h ^= static_cast<uint8_t>(name[i]);
+            h *= 16777619u;
+        }
+        return mix(h);
+    }
+
+    class Ring {
+    public:
+        void add(int backend, const std::string& name) {
+            for (int v = 0; v < VIRTUAL_NODES; v++) {
+                points[hashName(name + "#" + std::to_string(v))] = backend;
+            }
+        }
+
+        // Owner of plid: the first point at or after its hash
+        int lookup(uint32_t plid) const {
+            std::map<uint32_t, int>::const_iterator it = points.lower_bound(mix(plid));
+            if (it == points.end()) it = points.begin();
+            return it->second;
+        }
+
+    private:
+        std::map<uint32_t, int> points;
+    };
+
+    Ring ring;
+
+    // Backend of a text or binary request
+    int route(const std::string& request) {
+        uint32_t plid = 0;
+        if (protocols::isBinaryFrame(request)) {
+            protocols::BinaryHeader header;
+            if (protocols::decodeBinaryHeader(request, header)) plid = ntohl(header.plid);
+        } else {
+            char command[10], id[16];
+            if (sscanf(request.c_str(), "%9s %15s", command, id) == 2) {
+                plid = strtoul(id, nullptr, 10);
+            }
+        }
+        return ring.lookup(plid);
+    }
+
+    bool resolve(const std::string& host, const std::string& port, struct sockaddr_in& addr) {
+        struct addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        int errcode = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+        if (errcode != 0) {
+            std::cerr << "getaddrinfo error: " << gai_strerror(errcode) << "\n";
+            return false;
+        }
+        memcpy(&addr, res->ai_addr, sizeof(addr));
+        freeaddrinfo(res);
+        return true;
+    }
+
+    std::string formatAddress(const struct sockaddr_in& addr) {
+        char ipstr[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, ipstr, INET_ADDRSTRLEN);
+        return std::string(ipstr) + ":" + std::to_string(ntohs(addr.sin_port));
+    }
+
+    // ---------------------------------------------------------------- TCP
+
+    // Sends request to a backend and reads the reply until the GS closes
+    // the connection, "" if the backend cannot be reached
+    std::string exchangeTCP(const Backend& backend, const std::string& request) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1) return "";
+        struct timeval tv = {TIMEOUT_TIME, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(fd, (const struct sockaddr*)&backend.addr, sizeof(backend.addr)) == -1) {
+            std::cerr << "Cannot connect to backend " << backend.name << "\n";
+            close(fd);
+            return "";
+        }
+        protocols::sendTCPMessage(fd, request);
+
+        std::string reply;
+        char buffer[BUFFER_SIZE];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Error reading from backend " << backend.name << "\n";
+                reply.clear();
+                break;
+            }
+            reply.append(buffer, n);
+        }
+        close(fd);
+        return reply;
+    }
+
+    // File data of an "R.. OK Fname Fsize Fdata" reply, false for any other reply
+    bool replyFile(const std::string& reply, std::string& data) {
+        char command[10], status[10], fname[64];
+        size_t size;
+        int offset = 0;
+        if (sscanf(reply.c_str(), "%9s %9s %63s %zu %n", command, status, fname, &size, &offset) != 4 ||
+            strcmp(status, STATUS_OK) != 0 || offset == 0 || reply.size() < offset + size) {
+            return false;
+        }
+        data = reply.substr(offset, size);
+        return true;
+    }
+
+    struct ScoreEntry {
+        int score;
+        std::string plid;
+        std::string code;
+        int trials;
+        std::string mode;
+    };
+
+    // Top 10 over the scoreboards of every backend, in the GS format
+    std::string mergeScoreboards() {
+        std::vector<ScoreEntry> entries;
+        for (size_t b = 0; b < backends.size(); b++) {
+            std::string data;
+            if (!replyFile(exchangeTCP(backends[b], "SSB\n"), data)) continue;
+
+            std::istringstream lines(data);
+            std::string line;
+            while (std::getline(lines, line)) {
+                int rank, score, trials;
+                char plid[16], code[16], mode[16];
+                if (sscanf(line.c_str(), "%d - %d %15s %15s %d %15s",
+                           &rank, &score, plid, code, &trials, mode) == 6) {
+                    ScoreEntry entry = {score, plid, code, trials, mode};
+                    entries.push_back(entry);
+                }
+            }
+        }
+        if (entries.empty()) return "RSS EMPTY\n";
+
+        // Same order as a single GS: score, then PLID, highest first
+        std::stable_sort(entries.begin(), entries.end(), [](const ScoreEntry& a, const ScoreEntry& b) {
+            return a.score != b.score ? a.score > b.score : a.plid > b.plid;
+        });
+        if (entries.size() > 10) entries.resize(10);
+
+        std::string fileName = "TOP_10_SCORES_" + std::to_string(scoreboardCount++) + ".txt";
+        std::stringstream content;
+        content << "-------------------------------- TOP 10 SCORES --------------------------------\n\n"
+                << "                 SCORE PLAYER     CODE    NO TRIALS   MODE\n\n";
+        for (size_t i = 0; i < entries.size(); i++) {
+            content << "            "
+                    << std::right << std::setw(2) << (i + 1) << " - "
+                    << std::right << std::setw(4) << entries[i].score << "  "
+                    << std::left << std::setw(10) << entries[i].plid << " "
+                    << std::left << std::setw(8) << entries[i].code << "    "
+                    << std::right << std::setw(1) << entries[i].trials << "       "
+                    << std::left << entries[i].mode
+                    << "\n";
+        }
+        content << "\n";
+
+        std::string fileContent = content.str();
+        return "RSS OK " + fileName + " " + std::to_string(fileContent.length()) + " " +
+               fileContent + "\n";
+    }
+
+    // One win of an LDB page: its order on the board and the text after
+    // the rank column
+    struct BoardLine {
+        int score;
+        int64_t time;
+        uint32_t plid;
+        std::string tail;
+    };
+
+    // Same order as a GS board: score, then the earlier win, then the lower PLID
+    bool better(const BoardLine& a, const BoardLine& b) {
+        if (a.score != b.score) return a.score > b.score;
+        if (a.time != b.time) return a.time < b.time;
+        return a.plid < b.plid;
+    }
+
+    // Parses "RANK SCORE PLAYER CODE TRIALS MODE DATE", false for the
+    // other lines of a page
+    bool parseBoardLine(const std::string& line, BoardLine& entry) {
+        size_t rank;
+        unsigned plid;
+        char date[32];
+        int offset = 0;
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (sscanf(line.c_str(), "%zu%n %d %u %*s %*d %*s %31[^\n]",
+                   &rank, &offset, &entry.score, &plid, date) != 4 ||
+            !strptime(date, "%Y-%m-%d %H:%M:%S", &tm)) {
+            return false;
+        }
+        entry.time = timegm(&tm);
+        entry.plid = plid;
+        entry.tail = line.substr(offset);
+        return true;
+    }
+
+    // Walks the board of one backend in rank order, a page at a time
+    class BoardCursor {
+    public:
+        BoardCursor(const Backend& backend, const std::string& filter)
+            : total(0), backend(&backend), filter(filter), next(1), pos(0), done(false) {}
+
+        // Sets entry to the current win (nullptr past the end); false, with
+        // the reply to give the client in failure, if the backend fails
+        bool peek(const BoardLine*& entry) {
+            if (pos == page.size() && !done && !fetch()) return false;
+            entry = pos < page.size() ? &page[pos] : nullptr;
+            return true;
+        }
+        void pop() { pos++; }
+
+        size_t total;       // wins on the board, known after the first peek
+        std::string failure;
+
+    private:
+        bool fetch() {
+            std::string reply = exchangeTCP(*backend, "LDB " + std::to_string(next) + " " +
+                                            std::to_string(MAX_LEADERBOARD_PAGE) + " " + filter + "\n");
+            std::string data;
+            page.clear();
+            pos = 0;
+            if (reply.compare(0, 9, "RLB EMPTY") == 0) {
+                done = true;
+                return true;
+            }
+            size_t of = std::string::npos;
+            if (replyFile(reply, data)) of = data.find(" OF ");
+            if (of == std::string::npos) {
+                failure = reply.empty() ? "ERR\n" : reply;
+                return false;
+            }
+            total = strtoul(data.c_str() + of + 4, nullptr, 10);
+
+            std::istringstream lines(data);
+            std::string line;
+            BoardLine entry;
+            while (std::getline(lines, line)) {
+                if (parseBoardLine(line, entry)) page.push_back(entry);
+            }
+            next += page.size();
+            done = page.size() < (size_t)MAX_LEADERBOARD_PAGE;
+            return true;
+        }
+
+        const Backend* backend;
+        std::string filter;     // "MODE WINDOW"
+        size_t next;            // rank of the first win of the next page
+        std::vector<BoardLine> page;
+        size_t pos;
+        bool done;
+    };
+
+    // LDB over the boards of every backend: merges them in rank order up
+    // to the requested page, so a page deep in the board reads every
+    // backend down to that rank. Answers an error rather than a partial
+    // page when a backend fails.
+    std::string mergeLeaderboards(const std::string& request) {
+        int first, count;
+        char mode[8] = "ALL", window[8] = "ALL";
+        int n = sscanf(request.c_str(), "LDB %d %d %7s %7s", &first, &count, mode, window);
+        if (n < 2 || first < 1 || count < 1 || count > MAX_LEADERBOARD_PAGE) return "RLB ERR\n";
+
+        std::vector<BoardCursor> cursors;
+        for (size_t b = 0; b < backends.size(); b++) {
+            cursors.push_back(BoardCursor(backends[b], std::string(mode) + " " + window));
+        }
+        std::vector<BoardLine> entries;
+        for (size_t seen = 1; entries.size() < (size_t)count; seen++) {
+            int top = -1;
+            const BoardLine* best = nullptr;
+            for (size_t c = 0; c < cursors.size(); c++) {
+                const BoardLine* entry;
+                if (!cursors[c].peek(entry)) return cursors[c].failure;
+                if (entry && (!best || better(*entry, *best))) {
+                    top = c;
+                    best = entry;
+                }
+            }
+            if (top < 0) break;
+            if (seen >= (size_t)first) entries.push_back(*best);
+            cursors[top].pop();
+        }
+        if (entries.empty()) return "RLB EMPTY\n";
+        size_t total = 0;
+        for (size_t c = 0; c < cursors.size(); c++) total += cursors[c].total;
+
+        std::string fileName = std::string("LEADERBOARD_") + mode + "_" + window + "_" +
+                               std::to_string(first) + ".txt";
+        std::stringstream content;
+        content << "---------------- LEADERBOARD " << mode << " " << window << ": RANKS " << first
+                << " TO " << (first + entries.size() - 1) << " OF " << total << " ----------------\n\n"
+                << "   RANK SCORE PLAYER CODE NO TRIALS MODE  DATE\n\n";
+        for (size_t i = 0; i < entries.size(); i++) {
+            char rank[24];
+            snprintf(rank, sizeof(rank), "%7zu", first + i);
+            content << rank << entries[i].tail << "\n";
+        }
+        content << "\n";
+
+        std::string fileContent = content.str();
+        return "RLB OK " + fileName + " " + std::to_string(fileContent.length()) + " " +
+               fileContent + "\n";
+    }
+
+    // RNK over the boards of every backend: the owner of the PLID gives
+    // its best win, and every other backend the number of its wins better
+    // than that one (RNK PLID MODE WINDOW score time). Answers an error
+    // rather than a partial rank when a backend fails.
+    std::string mergeRank(const std::string& request) {
+        char plid[7], mode[8] = "ALL", window[8] = "ALL";
+        int score;
+        int n = sscanf(request.c_str(), "RNK %6s %7s %7s %d", plid, mode, window, &score);
+        int owner = route(request);
+        std::string reply = exchangeTCP(backends[owner], request);
+        size_t rank, total;
+        if (n < 1 || n == 4 || sscanf(reply.c_str(), "RRK OK %zu %zu %d", &rank, &total, &score) != 3) {
+            return reply.empty() ? "ERR\n" : reply;
+        }
+        std::string filter = std::string(mode) + " " + window;
+
+        // Time of the win, from the owner's board at that rank; a win
+        // taking the rank in between makes the answer an error
+        std::string data;
+        BoardLine best;
+        bool found = false;
+        if (replyFile(exchangeTCP(backends[owner], "LDB " + std::to_string(rank) + " 1 " + filter + "\n"), data)) {
+            std::istringstream lines(data);
+            std::string line;
+            while (!found && std::getline(lines, line)) {
+                found = parseBoardLine(line, best) && best.plid == strtoul(plid, nullptr, 10) &&
+                        best.score == score;
+            }
+        }
+        if (!found) return "ERR\n";
+
+        std::string probe = "RNK " + std::string(plid) + " " + filter + " " + std::to_string(score) + " " +
+                            std::to_string(best.time) + "\n";
+        for (size_t b = 0; b < backends.size(); b++) {
+            if ((int)b == owner) continue;
+            size_t better, wins;
+            reply = exchangeTCP(backends[b], probe);
+            if (sscanf(reply.c_str(), "RRK OK %zu %zu", &better, &wins) != 2) {
+                return reply.empty() ? "ERR\n" : reply;
+            }
+            rank += better - 1;
+            total += wins;
+        }
+        return "RRK OK " + std::to_string(rank) + " " + std::to_string(total) + " " +
+               std::to_string(score) + "\n";
+    }
+
+    // Metrics of every backend, one section each
+    std::string collectMetrics() {
+        std::string content;
+        for (size_t b = 0; b < backends.size(); b++) {
+            std::string data;
+            if (replyFile(exchangeTCP(backends[b], "MTR\n"), data)) {
+                content += "# backend " + backends[b].name + "\n" + data;
+            } else {
+                content += "# backend " + backends[b].name + " unreachable\n";
+            }
+        }
+        return "RMT OK metrics.txt " + std::to_string(content.length()) + " " + content;
+    }
+
+    void serveTCP(int fd, struct sockaddr_in client) {
+        struct timeval tv = {TIMEOUT_TIME, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        std::string request = protocols::receiveTCPMessage(fd);
+
+        protocols::BinaryHeader header;
+        bool binary = protocols::isBinaryFrame(request);
+        char command[10] = "";
+        if (binary) {
+            if (protocols::decodeBinaryHeader(request, header)) {
+                strncpy(command, protocols::binaryCommandName(header.opcode), sizeof(command) - 1);
+            }
+        } else {
+            sscanf(request.c_str(), "%9s", command);
+        }
+
+        std::string response;
+        if (strcmp(command, REQUEST_SCOREBOARD) == 0) {
+            response = mergeScoreboards();
+        } else if (strcmp(command, REQUEST_RANK) == 0 && backends.size() > 1) {
+            response = mergeRank(request);
+        } else if (strcmp(command, REQUEST_LEADERBOARD) == 0 && backends.size() > 1) {
+            response = mergeLeaderboards(request);
+        } else if (strcmp(command, REQUEST_METRICS) == 0 && !binary) {
+            // The backends see the proxy as a loopback client, so the
+            // admin check is made here
+            bool loopback = (ntohl(client.sin_addr.s_addr) >> 24) == 127;
+            response = loopback ? collectMetrics() : "RMT ERR\n";
+        } else {
+            int b = route(request);
+            if (verbose) {
+                std::cerr << formatAddress(client) << " TCP " << command << " -> " << backends[b].name << "\n";
+            }
+            response = exchangeTCP(backends[b], request);
+            if (response.empty()) response = "ERR\n";
+            else binary = false; // already in the client's protocol
+        }
+        if (binary) response = protocols::encodeBinaryResponse(response, header);
+
+        protocols::sendTCPMessage(fd, response);
+        close(fd);
+    }
+
+    // ---------------------------------------------------------------- UDP
+
+    // BAT split over several backends, waiting for their replies
+    struct SplitBatch {
+        bool active = false;
+        std::vector<std::string> replies;         // by request
+        std::vector<std::vector<size_t>> slots;   // by backend: requests of its sub-batch
+        std::vector<bool> waiting;                // by backend
+        size_t remaining = 0;
+    };
+
+    struct Upstream {
+        int fd;
+        struct sockaddr_in client;
+        time_t lastUsed;
+        bool split;             // the last BAT of the client was split
+        SplitBatch batch;
+    };
+
+    class Proxy {
+    public:
+        Proxy(int ufd, int tfd) : ufd(ufd), tfd(tfd), lastSweep(time(nullptr)) {}
+
+        void run() {
+            std::vector<struct pollfd> fds;
+            std::vector<uint64_t> keys;
+            while (true) {
+                fds.clear();
+                keys.clear();
+                struct pollfd p = {ufd, POLLIN, 0};
+                fds.push_back(p);
+                p.fd = tfd;
+                fds.push_back(p);
+                for (auto it = upstreams.begin(); it != upstreams.end(); ++it) {
+                    p.fd = it->second.fd;
+                    fds.push_back(p);
+                    keys.push_back(it->first);
+                }
+
+                if (poll(fds.data(), fds.size(), 1000) < 0) {
+                    if (errno == EINTR) continue;
+                    perror("poll");
+                    exit(EXIT_FAILURE);
+                }
+
+                for (size_t i = 2; i < fds.size(); i++) {
+                    if (fds[i].revents & POLLIN) fromBackends(upstreams[keys[i - 2]]);
+                }
+                if (fds[0].revents & POLLIN) fromClients();
+                if (fds[1].revents & POLLIN) acceptTCP();
+                sweep();
+            }
+        }
+
+    private:
+        static uint64_t key(const struct sockaddr_in& addr) {
+            return (uint64_t)ntohl(addr.sin_addr.s_addr) << 16 | ntohs(addr.sin_port);
+        }
+
+        Upstream& upstream(const struct sockaddr_in& client) {
+            uint64_t k = key(client);
+            auto it = upstreams.find(k);
+            if (it != upstreams.end()) return it->second;
+
+            Upstream up;
+            up.fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (up.fd == -1 || fcntl(up.fd, F_SETFL, O_NONBLOCK) == -1) {
+                perror("Error creating upstream socket");
+                exit(EXIT_FAILURE);
+            }
+            up.client = client;
+            up.split = false;
+            return upstreams[k] = up;
+        }
+
+        void send(int fd, const std::string& message, const struct sockaddr_in& to) {
+            if (sendto(fd, message.data(), message.size(), 0,
+                       (const struct sockaddr*)&to, sizeof(to)) < 0 && verbose) {
+                perror("sendto");
+            }
+        }
+
+        void fromClients() {
+            char buffer[BUFFER_SIZE];
+            struct sockaddr_in client;
+            socklen_t len = sizeof(client);
+            ssize_t n;
+            while ((n = recvfrom(ufd, buffer, sizeof(buffer), MSG_DONTWAIT,
+                                 (struct sockaddr*)&client, &len)) >= 0) {
+                std::string message(buffer, n);
+                Upstream& up = upstream(client);
+                up.lastUsed = time(nullptr);
+
+                char command[10] = "";
+                if (!protocols::isBinaryFrame(message)) sscanf(message.c_str(), "%9s", command);
+                int b;
+                if (strcmp(command, REQUEST_BATCH) == 0) {
+                    b = splitBatch(up, message);
+                    if (b < 0) continue;
+                } else {
+                    b = route(message);
+                }
+                if (verbose) {
+                    std::cerr << formatAddress(client) << " UDP "
+                              << (command[0] ? command : "binary") << " -> " << backends[b].name << "\n";
+                }
+                send(up.fd, message, backends[b].addr);
+                len = sizeof(client);
+            }
+        }
+
+        // Sends one sub-batch per backend owning some of the requests and
+        // returns -1, or returns the backend the whole batch goes to (the
+        // first one for a malformed batch, which it rejects)
+        int splitBatch(Upstream& up, const std::string& request) {
+            up.split = false;
+            int count;
+            if (sscanf(request.c_str(), "BAT %d", &count) != 1 || count <= 0 || count > MAX_BATCH_REQUESTS) {
+                return 0;
+            }
+            std::vector<std::string> lines;
+            size_t pos = request.find('\n');
+            while (pos != std::string::npos && pos + 1 < request.size()) {
+                size_t end = request.find('\n', pos + 1);
+                if (end == std::string::npos) break;
+                lines.push_back(request.substr(pos + 1, end - pos));
+                pos = end;
+            }
+            if ((int)lines.size() != count || pos + 1 != request.size()) return 0;
+
+            SplitBatch& batch = up.batch;
+            batch.slots.assign(backends.size(), std::vector<size_t>());
+            for (size_t i = 0; i < lines.size(); i++) {
+                batch.slots[route(lines[i])].push_back(i);
+            }
+            int owners = 0, owner = 0;
+            for (size_t b = 0; b < backends.size(); b++) {
+                if (!batch.slots[b].empty()) {
+                    owners++;
+                    owner = b;
+                }
+            }
+            if (owners == 1) return owner;
+
+            batch.active = true;
+            batch.replies.assign(lines.size(), std::string());
+            batch.waiting.assign(backends.size(), false);
+            batch.remaining = owners;
+            for (size_t b = 0; b < backends.size(); b++) {
+                if (batch.slots[b].empty()) continue;
+                std::string sub = "BAT " + std::to_string(batch.slots[b].size()) + "\n";
+                for (size_t i = 0; i < batch.slots[b].size(); i++) sub += lines[batch.slots[b][i]];
+                batch.waiting[b] = true;
+                send(up.fd, sub, backends[b].addr);
+            }
+            if (verbose) {
+                std::cerr << formatAddress(up.client) << " UDP BAT " << count << " split over "
+                          << owners << " backends\n";
+            }
+            up.split = true;
+            return -1;
+        }
+
+        void fromBackends(Upstream& up) {
+            char buffer[BUFFER_SIZE * 16];
+            struct sockaddr_in from;
+            socklen_t len = sizeof(from);
+            ssize_t n;
+            while ((n = recvfrom(up.fd, buffer, sizeof(buffer), MSG_DONTWAIT,
+                                 (struct sockaddr*)&from, &len)) >= 0) {
+                std::string reply(buffer, n);
+                len = sizeof(from);
+                if (!up.split || reply.compare(0, 3, RESPONSE_BATCH) != 0) {
+                    send(ufd, reply, up.client);
+                    continue;
+                }
+                // Sub-batch replies; late ones (from a batch already
+                // answered) are dropped
+                SplitBatch& batch = up.batch;
+                size_t b = 0;
+                while (b < backends.size() && (backends[b].addr.sin_addr.s_addr != from.sin_addr.s_addr ||
+                                               backends[b].addr.sin_port != from.sin_port)) {
+                    b++;
+                }
+                if (!batch.active || b == backends.size() || !batch.waiting[b]) continue;
+
+                std::vector<std::string> parts = protocols::unpackBatchResponse(reply);
+                for (size_t i = 0; i < batch.slots[b].size(); i++) {
+                    batch.replies[batch.slots[b][i]] =
+                        parts.size() == batch.slots[b].size() ? parts[i] : std::string("ERR\n");
+                }
+                batch.waiting[b] = false;
+                if (--batch.remaining > 0) continue;
+
+                std::string merged = "RBT OK " + std::to_string(batch.replies.size()) + "\n";
+                for (size_t i = 0; i < batch.replies.size(); i++) merged += batch.replies[i];
+                batch.active = false;
+                send(ufd, merged, up.client);
+            }
+        }
+
+        void acceptTCP() {
+            struct sockaddr_in client;
+            socklen_t len = sizeof(client);
+            int fd = accept(tfd, (struct sockaddr*)&client, &len);
+            if (fd < 0) return;
+            std::thread(serveTCP, fd, client).detach();
+        }
+
+        // Closes the upstream sockets of clients gone quiet
+        void sweep() {
+            time_t now = time(nullptr);
+            if (now - lastSweep < 10) return;
+            lastSweep = now;
+            for (auto it = upstreams.begin(); it != upstreams.end();) {
+                if (now - it->second.lastUsed > UPSTREAM_IDLE) {
+                    close(it->second.fd);
+                    it = upstreams.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        int ufd, tfd;
+        time_t lastSweep;
+        std::unordered_map<uint64_t, Upstream> upstreams; // by client address and port
+    };
+
+    void setupSockets(int port, int& ufd, int& tfd) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+
+        int yes = 1;
+        ufd = socket(AF_INET, SOCK_DGRAM, 0);
+        tfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (ufd == -1 || tfd == -1 ||
+            setsockopt(tfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+            bind(ufd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+            bind(tfd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+            listen(tfd, SOMAXCONN) == -1) {
+            perror("Error setting up proxy sockets");
+            exit(EXIT_FAILURE);
+        }
+        // Room for bursts of requests from many clients
+        int size = 1 << 20;
+        setsockopt(ufd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int port = DSPORT_DEFAULT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t colon = spec.rfind(':');
+            Backend backend;
+            backend.name = spec;
+            if (colon == std::string::npos ||
+                !resolve(spec.substr(0, colon), spec.substr(colon + 1), backend.addr)) {
+                std::cerr << "Invalid backend " << spec << "\n";
+                return 1;
+            }
+            backends.push_back(backend);
+        } else {
+            backends.clear();
+            break;
+        }
+    }
+    if (backends.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-p GSport] [-v] -b host:port [-b host:port ...]" << std::endl;
+        return 1;
+    }
+    for (size_t b = 0; b < backends.size(); b++) ring.add(b, backends[b].name);
+
+    // A client closing its TCP connection early must not kill the proxy
+    signal(SIGPIPE, SIG_IGN);
+
+    int ufd, tfd;
+    setupSockets(port, ufd, tfd);
+    std::cout << "Proxy listening on port " << port << ", " << backends.size() << " backends\n";
+    Proxy proxy(ufd, tfd);
+    proxy.run();
+    return 0;
+}
@@ -0,0 +1,204 @@
+// Replays a GS traffic capture (GS -c file) against a running GS.
+//
+// Each request is paired with the next response recorded for the same
+// client (address, port and transport) and sent when that response is
+// read, either at the original pacing or as fast as possible (-f); every
+// reply is compared byte for byte with the recorded response. The report compares the latency the
+// original GS spent on each request with the round trip latency of the
+// replay. Replies depend on the secrets of the games, so a capture only
+// replays without mismatches against a GS started from the same data
+// directory state with deterministic secrets.
+//
+// Usage: ./GSreplay [-n GSIP] [-p GSport] [-f] [-j] [-v] capturefile
+
+#include "../Server/capture.hpp"
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+namespace {
+    struct Summary {
+        std::vector<double> recordedUs; // GS service time in the capture
+        std::vector<double> replayUs;   // round trip time of the replay
+        long requests = 0;
+        long mismatches = 0;
+        long timeouts = 0;
+    };
+
+    struct Request {
+        capture::RecordHeader header;
+        std::string data;
+    };
+
+    uint64_t clientKey(const capture::RecordHeader& header) {
+        return (uint64_t)header.addr << 17 | (uint64_t)header.port << 1 | header.isTCP;
+    }
+
+    double percentile(std::vector<double>& values, double p) {
+        if (values.empty()) return 0;
+        std::sort(values.begin(), values.end());
+        size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+        return values[index];
+    }
+
+    std::string sendRequest(int udpSocket, struct addrinfo* udpRes, struct addrinfo* tcpRes,
+                            const capture::RecordHeader& header, const std::string& request) {
+        if (!header.isTCP) {
+            protocols::sendUDPMessage(udpSocket, request, (struct sockaddr_in*)udpRes->ai_addr, udpRes->ai_addrlen);
+            return protocols::receiveUDPMessage(udpSocket, (struct sockaddr_in*)udpRes->ai_addr, &udpRes->ai_addrlen);
+        }
+
+        int tcpSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (tcpSocket == -1 || connect(tcpSocket, tcpRes->ai_addr, tcpRes->ai_addrlen) < 0) {
+            std::cerr << "Error connecting to server.\n";
+            if (tcpSocket != -1) close(tcpSocket);
+            return "";
+        }
+        protocols::sendTCPMessage(tcpSocket, request);
+        std::string response = protocols::receiveTCPReply(tcpSocket);
+        close(tcpSocket);
+        return response;
+    }
+
+    void printDistribution(const char* name, std::vector<double>& values, bool json, bool last) {
+        double p50 = percentile(values, 0.5), p90 = percentile(values, 0.9);
+        double p99 = percentile(values, 0.99), max = values.empty() ? 0 : values.back();
+        if (json) {
+            fprintf(stdout, "\"%s\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}%s",
+                    name, p50, p90, p99, max, last ? "" : ",");
+        } else {
+            fprintf(stdout, "%-10s p50 %10.1f  p90 %10.1f  p99 %10.1f  max %10.1f\n",
+                    name, p50, p90, p99, max);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string serverIP = DSIP_DEFAULT;
+    int serverPort = DSPORT_DEFAULT;
+    bool fast = false, json = false, verbose = false;
+    std::string path;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            serverIP = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            serverPort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            fast = true;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (path.empty() && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-n GSIP] [-p GSport] [-f] [-j] [-v] capturefile" << std::endl;
+        return 1;
+    }
+
+    capture::Reader reader;
+    if (!reader.open(path)) return 1;
+
+    struct addrinfo hints, *udpRes, *tcpRes;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    std::string portStr = std::to_string(serverPort);
+    int errcode = getaddrinfo(serverIP.c_str(), portStr.c_str(), &hints, &udpRes);
+    if (errcode == 0) {
+        hints.ai_socktype = SOCK_STREAM;
+        errcode = getaddrinfo(serverIP.c_str(), portStr.c_str(), &hints, &tcpRes);
+    }
+    if (errcode != 0) {
+        std::cerr << "getaddrinfo error: " << gai_strerror(errcode) << "\n";
+        return 1;
+    }
+
+    int udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = {TIMEOUT_TIME, 0};
+    if (udpSocket == -1 ||
+        setsockopt(udpSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        std::cerr << "Error creating UDP socket.\n";
+        return 1;
+    }
+
+    Summary summary;
+    capture::RecordHeader recorded;
+    std::string recordedData;
+    // Requests waiting for their response, by client
+    std::unordered_map<uint64_t, std::deque<Request>> pending;
+    uint64_t firstTimestamp = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (reader.next(recorded, recordedData)) {
+        uint64_t key = clientKey(recorded);
+        if (recorded.type == capture::REQUEST) {
+            Request request = {recorded, recordedData};
+            pending[key].push_back(std::move(request));
+            continue;
+        }
+        auto it = pending.find(key);
+        if (recorded.type != capture::RESPONSE || it == pending.end()) continue;
+        Request request = std::move(it->second.front());
+        it->second.pop_front();
+        if (it->second.empty()) pending.erase(it);
+
+        if (firstTimestamp == 0) firstTimestamp = request.header.timestampNs;
+        if (!fast && request.header.timestampNs > firstTimestamp) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(request.header.timestampNs - firstTimestamp));
+        }
+
+        auto sent = std::chrono::steady_clock::now();
+        std::string response = sendRequest(udpSocket, udpRes, tcpRes, request.header, request.data);
+        std::chrono::duration<double, std::micro> rtt = std::chrono::steady_clock::now() - sent;
+
+        summary.requests++;
+        summary.recordedUs.push_back((recorded.timestampNs - request.header.timestampNs) / 1000.0);
+        summary.replayUs.push_back(rtt.count());
+        if (response == "Failed to receive UDP message.\n") {
+            summary.timeouts++;
+        } else if (response != recordedData) {
+            summary.mismatches++;
+            if (verbose) {
+                std::cerr << "Mismatch for request: " << request.data
+                          << "    recorded: " << recordedData
+                          << "    replayed: " << response;
+            }
+        }
+    }
+    size_t unanswered = 0;
+    for (auto it = pending.begin(); it != pending.end(); ++it) unanswered += it->second.size();
+    if (unanswered > 0) {
+        std::cerr << "Capture truncated: " << unanswered << " requests without a recorded response\n";
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (json) {
+        fprintf(stdout, "{\"requests\":%ld,\"mismatches\":%ld,\"timeouts\":%ld,\"seconds\":%.3f,",
+                summary.requests, summary.mismatches, summary.timeouts, elapsed.count());
+        printDistribution("recorded_us", summary.recordedUs, true, false);
+        printDistribution("replay_us", summary.replayUs, true, true);
+        fprintf(stdout, "}\n");
+    } else {
+        fprintf(stdout, "Requests: %ld  Mismatches: %ld  Timeouts: %ld  Time: %.3fs\n",
+                summary.requests, summary.mismatches, summary.timeouts, elapsed.count());
+        fprintf(stdout, "Latency (us):\n");
+        printDistribution("recorded", summary.recordedUs, false, false);
+        printDistribution("replay", summary.replayUs, false, true);
+    }
+
+    freeaddrinfo(udpRes);
+    freeaddrinfo(tcpRes);
+    close(udpSocket);
+    return summary.mismatches == 0 && summary.timeouts == 0 ? 0 : 2;
+}
@@ -0,0 +1,388 @@
+// Capacity planning: plays scripted sessions through the real GS handlers
+// in virtual time.
+//
+// The players are simulated in-process and their requests go straight to
+// Server::handleRequest (no sockets), while the games read a virtual clock
+// (Game::setTimeSource) that jumps from one request to the next, so hours of
+// play, with think times and abandoned games running into their time limit,
+// take seconds. Secrets come from a seeded generator (Game::setSecretSource),
+// so two runs with the same options play the same games.
+//
+// Every player plays games back to back: SNG, then trials of a random code
+// still consistent with the feedback, a think time apart. Some games are
+// quit (-q) and some abandoned (-a), left to time out and finalized by the
+// player's next SNG. The report gives the cost of the handlers per command,
+// the memory of the process (RSS) every -i virtual seconds and the disk
+// used by the data directory at the end.
+//
+// Usage: ./GSsim [-s sessions] [-P players] [-t maxTime] [-g think] [-q quit%]
+//                [-a abandon%] [-m budget] [-i interval] [-S seed] [-d datadir] [-j]
+
+#include "../Server/server.hpp"
+#include "../constant.hpp"
+#include "../utils.hpp"
+#include <ftw.h>
+#include <queue>
+
+// Friend of Server: forwards to the private methods driven by the simulation
+class ServerHarness {
+public:
+    static std::string handleRequest(Server& s, const std::string& request) {
+        return s.handleRequest(request, false, nullptr);
+    }
+    static size_t activeGames(Server& s) { return s.activeGames.size(); }
+};
+
+namespace {
+    const int HISTOGRAM_BUCKETS = 40;   // powers of two of nanoseconds
+
+    // Virtual clock and secrets of the games
+    time_t virtualNow;
+    std::mt19937_64 generator;
+
+    time_t virtualTime() { return virtualNow; }
+
+    std::string scriptedSecret() {
+        return solver::decodeCode(std::uniform_int_distribution<int>(0, solver::NUM_CODES - 1)(generator));
+    }
+
+    struct Player {
+        std::string plid;
+        bool playing = false;
+        int nT = 0;
+        int stopAfter = -1;     // trials before quitting or abandoning, -1 to play on
+        bool abandon = false;
+        solver::CodeSet candidates;
+    };
+
+    struct Cost {
+        long count = 0;
+        double totalNs = 0;
+        double maxNs = 0;
+        long buckets[HISTOGRAM_BUCKETS] = {0};
+
+        void add(double ns) {
+            count++;
+            totalNs += ns;
+            maxNs = std::max(maxNs, ns);
+            int b = 0;
+            while (b < HISTOGRAM_BUCKETS - 1 && ns >= (double)(2LL << b)) b++;
+            buckets[b]++;
+        }
+        // Upper bound of the bucket holding the q quantile
+        double quantile(double q) const {
+            long seen = 0;
+            for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+                seen += buckets[b];
+                if (seen > 0 && seen >= q * count) return (double)(2LL << b);
+            }
+            return 0;
+        }
+    };
+
+    struct Sample {
+        long virtualSeconds;
+        long sessions;
+        size_t activeGames;
+        long rssKB;
+    };
+
+    struct Summary {
+        long sessions = 0, won = 0, lost = 0, quit = 0, abandoned = 0, timedOut = 0, failed = 0;
+        std::map<std::string, Cost> costs;  // by command
+        std::vector<Sample> samples;
+        long files = 0, dirs = 0;
+        long long diskBytes = 0;
+    };
+
+    Summary summary;
+
+    long residentKB() {
+        long pages = 0;
+        FILE* fp = fopen("/proc/self/statm", "r");
+        if (fp) {
+            if (fscanf(fp, "%*s %ld", &pages) != 1) pages = 0;
+            fclose(fp);
+        }
+        return pages * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    int countFile(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+        if (type == FTW_F) {
+            summary.files++;
+            summary.diskBytes += (long long)st->st_blocks * 512;
+        } else if (type == FTW_D) {
+            summary.dirs++;
+        }
+        return 0;
+    }
+
+    class Simulation {
+    public:
+        Simulation(Server& server, int players, long sessions, int maxTime, double think,
+                   int quitPercent, int abandonPercent)
+            : server(server), players(players), sessions(sessions), maxTime(maxTime),
+              think(think), quitPercent(quitPercent), abandonPercent(abandonPercent) {
+            char plid[8];
+            for (int i = 0; i < players; i++) {
+                snprintf(plid, sizeof(plid), "%06d", i);
+                this->players[i].plid = plid;
+                // Players arrive over the first think time
+                events.push(std::make_pair(virtualNow + i % std::max(1, (int)think), i));
+            }
+        }
+
+        // Plays until every session has ended, sampling every interval seconds
+        void run(long interval) {
+            time_t start = virtualNow, nextSample = start;
+            while (!events.empty()) {
+                time_t when = events.top().first;
+                int i = events.top().second;
+                events.pop();
+                while (when >= nextSample) {
+                    virtualNow = nextSample;
+                    sample(start);
+                    nextSample += interval;
+                }
+                virtualNow = when;
+                step(i);
+            }
+            sample(start);
+        }
+
+    private:
+        typedef std::pair<time_t, int> Event;
+
+        std::string send(const std::string& request) {
+            auto start = std::chrono::steady_clock::now();
+            std::string response = ServerHarness::handleRequest(server, request);
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            summary.costs[request.substr(0, 3)].add(elapsed.count());
+            return response;
+        }
+
+        void schedule(int i, double seconds) {
+            events.push(std::make_pair(virtualNow + std::max<time_t>(1, (time_t)seconds), i));
+        }
+
+        double thinkTime() { return std::exponential_distribution<double>(1.0 / think)(generator); }
+
+        bool percent(int p) { return std::uniform_int_distribution<int>(0, 99)(generator) < p; }
+
+        void step(int i) {
+            Player& player = players[i];
+            if (!player.playing) {
+                if (summary.sessions == sessions) return;
+                start(i);
+            } else if (player.nT == player.stopAfter) {
+                stop(i);
+            } else {
+                play(i);
+            }
+        }
+
+        void start(int i) {
+            Player& player = players[i];
+            std::string response = send("SNG " + player.plid + " " + std::to_string(maxTime) + "\n");
+            if (response.compare(0, 7, "RSG OK\n") != 0) {
+                summary.failed++;
+                schedule(i, thinkTime());
+                return;
+            }
+            summary.sessions++;
+            player.playing = true;
+            player.nT = 0;
+            player.candidates.fill();
+            player.stopAfter = -1;
+            player.abandon = false;
+            if (percent(abandonPercent)) {
+                player.abandon = true;
+                player.stopAfter = std::uniform_int_distribution<int>(0, 3)(generator);
+            } else if (percent(quitPercent)) {
+                player.stopAfter = std::uniform_int_distribution<int>(0, 3)(generator);
+            }
+            schedule(i, thinkTime());
+        }
+
+        void stop(int i) {
+            Player& player = players[i];
+            player.playing = false;
+            if (player.abandon) {
+                // Back after the game timed out; its next SNG finalizes it
+                summary.abandoned++;
+                schedule(i, maxTime + 1 + thinkTime());
+                return;
+            }
+            send("QUT " + player.plid + "\n");
+            summary.quit++;
+            schedule(i, thinkTime());
+        }
+
+        void play(int i) {
+            Player& player = players[i];
+            std::vector<uint16_t> codes = player.candidates.toVector();
+            int guess = codes[std::uniform_int_distribution<size_t>(0, codes.size() - 1)(generator)];
+            std::string response = send("TRY " + player.plid + " " + solver::decodeCode(guess) + " " +
+                                        std::to_string(player.nT + 1) + "\n");
+            char status[8] = "";
+            int nT, nB, nW;
+            sscanf(response.c_str(), "%*s %7s", status);
+            if (strcmp(status, STATUS_OK) == 0 &&
+                sscanf(response.c_str(), "%*s %*s %d %d %d", &nT, &nB, &nW) == 3) {
+                player.nT = nT;
+                if (nB == solver::NUM_PEGS) {
+                    summary.won++;
+                    player.playing = false;
+                } else {
+                    player.candidates.prune(guess, solver::feedbackIndex(nB, nW));
+                }
+            } else {
+                if (strcmp(status, NO_TRIAL) == 0) {
+                    summary.lost++;
+                } else if (strcmp(status, MAX_TIME) == 0) {
+                    summary.timedOut++;
+                } else {
+                    summary.failed++;
+                }
+                player.playing = false;
+            }
+            schedule(i, thinkTime());
+        }
+
+        void sample(time_t start) {
+            Sample s;
+            s.virtualSeconds = virtualNow - start;
+            s.sessions = summary.sessions;
+            s.activeGames = ServerHarness::activeGames(server);
+            s.rssKB = residentKB();
+            summary.samples.push_back(s);
+        }
+
+        Server& server;
+        std::vector<Player> players;
+        long sessions;
+        int maxTime;
+        double think;   // mean think time, seconds
+        int quitPercent, abandonPercent;
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    };
+
+    void printReport(bool json, double wallSeconds) {
+        const Sample& first = summary.samples.front();
+        const Sample& last = summary.samples.back();
+        if (json) {
+            fprintf(stdout, "{\"sessions\":%ld,\"won\":%ld,\"lost\":%ld,\"quit\":%ld,\"abandoned\":%ld,"
+                    "\"timed_out\":%ld,\"failed\":%ld,\"virtual_seconds\":%ld,\"wall_seconds\":%.3f,",
+                    summary.sessions, summary.won, summary.lost, summary.quit, summary.abandoned,
+                    summary.timedOut, summary.failed, last.virtualSeconds, wallSeconds);
+            fprintf(stdout, "\"handlers\":{");
+            for (auto it = summary.costs.begin(); it != summary.costs.end(); ++it) {
+                const Cost& c = it->second;
+                fprintf(stdout, "%s\"%s\":{\"count\":%ld,\"mean_ns\":%.0f,\"p50_ns\":%.0f,"
+                        "\"p99_ns\":%.0f,\"max_ns\":%.0f}", it == summary.costs.begin() ? "" : ",",
+                        it->first.c_str(), c.count, c.totalNs / c.count, c.quantile(0.5),
+                        c.quantile(0.99), c.maxNs);
+            }
+            fprintf(stdout, "},\"memory\":[");
+            for (size_t i = 0; i < summary.samples.size(); i++) {
+                const Sample& s = summary.samples[i];
+                fprintf(stdout, "%s{\"virtual_seconds\":%ld,\"sessions\":%ld,\"active_games\":%zu,"
+                        "\"rss_kb\":%ld}", i ? "," : "", s.virtualSeconds, s.sessions, s.activeGames,
+                        s.rssKB);
+            }
+            fprintf(stdout, "],\"disk\":{\"files\":%ld,\"dirs\":%ld,\"bytes\":%lld}}\n",
+                    summary.files, summary.dirs, summary.diskBytes);
+            return;
+        }
+
+        fprintf(stdout, "Sessions: %ld  Won: %ld  Lost: %ld  Quit: %ld  Abandoned: %ld  "
+                "Timed out: %ld  Failed: %ld\n", summary.sessions, summary.won, summary.lost,
+                summary.quit, summary.abandoned, summary.timedOut, summary.failed);
+        fprintf(stdout, "Virtual time: %lds  Wall time: %.3fs  (%.0fx)\n\n", last.virtualSeconds,
+                wallSeconds, wallSeconds > 0 ? last.virtualSeconds / wallSeconds : 0);
+        fprintf(stdout, "%-8s %10s %10s %10s %10s %10s\n", "handler", "count", "mean ns", "p50 ns",
+                "p99 ns", "max ns");
+        for (auto it = summary.costs.begin(); it != summary.costs.end(); ++it) {
+            const Cost& c = it->second;
+            fprintf(stdout, "%-8s %10ld %10.0f %10.0f %10.0f %10.0f\n", it->first.c_str(), c.count,
+                    c.totalNs / c.count, c.quantile(0.5), c.quantile(0.99), c.maxNs);
+        }
+        fprintf(stdout, "\n%12s %10s %12s %10s\n", "virtual s", "sessions", "active games", "RSS KB");
+        for (size_t i = 0; i < summary.samples.size(); i++) {
+            const Sample& s = summary.samples[i];
+            fprintf(stdout, "%12ld %10ld %12zu %10ld\n", s.virtualSeconds, s.sessions, s.activeGames,
+                    s.rssKB);
+        }
+        fprintf(stdout, "\nMemory growth: %ld KB  Disk: %lld KB in %ld files, %ld directories\n",
+                last.rssKB - first.rssKB, summary.diskBytes / 1024, summary.files, summary.dirs);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long sessions = 100000, interval = 3600;
+    int players = 1000, maxTime = 600, quitPercent = 5, abandonPercent = 10, budget = 0;
+    double think = 20;
+    uint64_t seed = 1;
+    std::string dataDir = "sim";
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sessions = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            players = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            maxTime = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            think = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            quitPercent = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            abandonPercent = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            interval = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            json = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-s sessions] [-P players] [-t maxTime] [-g think]"
+                      << " [-q quit%] [-a abandon%] [-m budget] [-i interval] [-S seed] [-d datadir] [-j]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (sessions <= 0 || players <= 0 || players > 1000000 || maxTime <= 0 || maxTime > 600 ||
+        think <= 0 || interval <= 0) {
+        std::cerr << "Invalid options: PLIDs must stay below 1000000 and maxTime at most 600\n";
+        return 1;
+    }
+
+    // Same layout as "GS -d datadir"
+    if ((mkdir(dataDir.c_str(), 0777) == -1 && errno != EEXIST) || chdir(dataDir.c_str()) == -1 ||
+        (mkdir("Server", 0777) == -1 && errno != EEXIST)) {
+        perror(("Cannot use data directory " + dataDir).c_str());
+        return 1;
+    }
+
+    generator.seed(seed);
+    virtualNow = time(nullptr);
+    Game::setTimeSource(virtualTime);
+    Game::setSecretSource(scriptedSecret);
+
+    Server server(false);
+    server.loadScores();
+    server.setSessionBudget(budget);
+    Simulation simulation(server, players, sessions, maxTime, think, quitPercent, abandonPercent);
+    auto start = std::chrono::steady_clock::now();
+    simulation.run(interval);
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+    nftw("Server", countFile, 64, FTW_PHYS);
+    printReport(json, wall.count());
+    return 0;
+}
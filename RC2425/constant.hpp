@@ -13,6 +13,9 @@
 #define SUCCESS 0
 #define VALID 1
 #define MAX_ATTEMPTS 8
+#define SUSPICIOUS_CANDIDATES 100 // Play mode wins with more candidates left are flagged
+#define RESEND_WINDOW 30          // seconds a TRY that ended a game can still be resent
+#define REPLY_CACHE_WINDOW 10     // seconds a UDP reply is kept to answer retransmissions
 
 #define REQUEST_START "SNG"
 #define REQUEST_TRY "TRY"
@@ -20,6 +23,14 @@
 #define REQUEST_SCOREBOARD "SSB"
 #define REQUEST_QUIT "QUT"
 #define REQUEST_DEBUG "DBG"
+#define REQUEST_HINT "HNT"
+#define REQUEST_METRICS "MTR"
+#define REQUEST_BATCH "BAT"
+#define REQUEST_PROMOTE "PRM"
+#define REQUEST_RANK "RNK"
+#define REQUEST_LEADERBOARD "LDB"
+#define REQUEST_PLAYER_STATS "PST"
+#define REQUEST_EXPORT "EXP"
 
 
 #define RESPONSE_START "RSG"
@@ -28,11 +39,20 @@
 #define RESPONSE_SCOREBOARD "RSS"
 #define RESPONSE_QUIT "RQT"
 #define RESPONSE_DEBUG "RDB"
+#define RESPONSE_HINT "RHN"
+#define RESPONSE_METRICS "RMT"
+#define RESPONSE_BATCH "RBT"
+#define RESPONSE_PROMOTE "RPM"
+#define RESPONSE_RANK "RRK"
+#define RESPONSE_LEADERBOARD "RLB"
+#define RESPONSE_PLAYER_STATS "RPS"
+#define RESPONSE_EXPORT "REX"
 
 
 #define STATUS_OK "OK"
 #define STATUS_NOK "NOK"
 #define STATUS_ERR "ERR"
+#define STATUS_BUSY "BSY"
 #define INVALID_TRY "INV"
 #define DUPLICATE_TRY "DUP"
 #define NO_TRIAL "ENT"
@@ -44,5 +64,15 @@
 //SIZES//
 #define MAX_INPUT_SIZE 512
 #define BUFFER_SIZE 4096
+#define MAX_FILE_SIZE (64 << 20)    // largest Fsize a TCP reply may announce
+#define BATCH_MTU 1472          // UDP payload of a 1500 byte Ethernet frame
+#define MAX_BATCH_REQUESTS 128
+#define MAX_LEADERBOARD_PAGE 100  // entries of one LDB reply
+#define EXPORT_CHUNK 16384      // game file bytes read into one EXP chunk
+#define MAX_EXPORTS 32          // EXP streams in progress at once
+#define EXPORT_IDLE_TIMEOUT 30  // seconds an EXP stream may stall before it is dropped
+#define UPGRADE_DRAIN_TIMEOUT 30  // seconds an upgraded GS keeps finishing exports and replication
+#define UDP_QUEUE_LIMIT 512     // UDP requests read ahead of the handlers, the rest get BSY
+#define UDP_BATCH 32            // queued UDP requests handled between two reads of the sockets
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "strategy.hpp"
+#include "utils.hpp"
+#include <sys/mman.h>
+#include <fcntl.h>
+
+namespace strategy {
+
+    bool write(const std::string& path, const std::vector<Node>& nodes,
+               uint32_t maxTrials, uint64_t totalTrials) {
+        FileHeader header;
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.nodes = nodes.size();
+        header.maxTrials = maxTrials;
+        header.totalTrials = totalTrials;
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Cannot create strategy file " << path << "\n";
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(nodes.data(), sizeof(Node), nodes.size(), file) == nodes.size();
+        if (fclose(file) != 0 || !ok) {
+            std::cerr << "Error writing strategy file " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool Table::open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            std::cerr << "Cannot open strategy file " << path << "\n";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(FileHeader)) {
+            std::cerr << "Not a strategy file: " << path << "\n";
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            std::cerr << "Cannot map strategy file " << path << "\n";
+            return false;
+        }
+
+        const FileHeader* h = static_cast<const FileHeader*>(map);
+        if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->nodes == 0 ||
+            size != sizeof(FileHeader) + (size_t)h->nodes * sizeof(Node)) {
+            std::cerr << "Not a strategy file: " << path << "\n";
+            close();
+            return false;
+        }
+        header = h;
+        nodes = reinterpret_cast<const Node*>(h + 1);
+        return true;
+    }
+
+    void Table::close() {
+        if (map) munmap(map, size);
+        map = nullptr;
+        header = nullptr;
+        nodes = nullptr;
+    }
+
+    std::string Table::guess(uint32_t node) const {
+        return protocols::unpackCode(nodes[node].guess);
+    }
+
+    int64_t Table::next(uint32_t node, int nB, int nW) const {
+        if (nB < 0 || nW < 0 || nB + nW > 4) return -1;
+        uint32_t bit = 1u << feedbackIndex(nB, nW);
+        const Node& n = nodes[node];
+        if (!(n.childMask & bit)) return -1;
+        uint32_t child = n.firstChild + __builtin_popcount(n.childMask & (bit - 1));
+        return child < header->nodes ? child : -1;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __H_STRATEGY
+#define __H_STRATEGY
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Precomputed strategy tables (built by GSstrategy, played by the player's
+// autoplay command and GSbots).
+//
+// A table is a decision tree stored as a flat array of nodes, node 0 being
+// the first guess. The children of a node are stored contiguously, one for
+// each feedback (nB * 5 + nW) that needs another guess, in feedback order,
+// so the next guess is found with a mask and a popcount. The file is
+// mapped read-only as is: the 24 byte header followed by the nodes, in
+// host byte order.
+namespace strategy {
+
+    const char MAGIC[8] = {'G', 'S', 'S', 'T', 'R', 'A', 'T', '1'};
+    const char DEFAULT_FILE[] = "strategy.bin";
+
+    struct __attribute__((packed)) FileHeader {
+        char magic[8];
+        uint32_t nodes;
+        uint32_t maxTrials;   // deepest leaf
+        uint64_t totalTrials; // sum of the trials over all 1296 secrets
+    };
+
+    struct __attribute__((packed)) Node {
+        uint16_t guess;       // code index (protocols::packCode)
+        uint16_t reserved;
+        uint32_t firstChild;  // node of the lowest feedback set in childMask
+        uint32_t childMask;   // bit nB * 5 + nW set when that feedback has a child
+    };
+
+    inline int feedbackIndex(int nB, int nW) { return nB * 5 + nW; }
+
+    bool write(const std::string& path, const std::vector<Node>& nodes,
+               uint32_t maxTrials, uint64_t totalTrials);
+
+    class Table {
+    public:
+        Table() : map(nullptr), size(0), header(nullptr), nodes(nullptr) {}
+        ~Table() { close(); }
+
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() const { return nodes != nullptr; }
+
+        const FileHeader& info() const { return *header; }
+        // Guess of a node, as "R G B Y"
+        std::string guess(uint32_t node) const;
+        // Node to play after the feedback to the guess of node, -1 if the
+        // feedback is a win or cannot happen
+        int64_t next(uint32_t node, int nB, int nW) const;
+
+    private:
+        void* map;
+        size_t size;
+        const FileHeader* header;
+        const Node* nodes;
+    };
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "utils.hpp"
 #include "constant.hpp"
+#include <algorithm>
+#include <cmath>
 
 namespace protocols {
     void sendTCPMessage(int sock, const std::string& message) {
@@ -57,7 +59,14 @@ namespace protocols {
             buffer[received] = '\0';
             message += std::string(buffer, received);
             
-            // Check for message completion
+            // Check for message completion: binary requests are a bare
+            // header, text messages end at the first newline
+            if (isBinaryFrame(message)) {
+                if (message.size() >= sizeof(BinaryHeader)) {
+                    break;
+                }
+                continue;
+            }
             size_t newline_pos = message.find('\n');
             if (newline_pos != std::string::npos) {
                 break;
@@ -67,6 +76,76 @@ namespace protocols {
         return message;
     }
 
+    namespace {
+        // Length of the reply starting with message, 0 while it is unknown
+        size_t replyLength(const std::string& message) {
+            if (isBinaryFrame(message)) {
+                BinaryHeader header;
+                return decodeBinaryHeader(message, header) ? sizeof(BinaryHeader) + ntohl(header.length) : 0;
+            }
+            // "CMD status\n", or for the replies carrying a file
+            // "CMD status Fname Fsize " and Fsize bytes
+            static const char* FILE_REPLIES[] = {RESPONSE_SHOW_TRIALS, RESPONSE_SCOREBOARD,
+                                                 RESPONSE_METRICS, RESPONSE_LEADERBOARD};
+            bool file = false;
+            for (size_t i = 0; i < sizeof(FILE_REPLIES) / sizeof(FILE_REPLIES[0]); i++) {
+                size_t n = strlen(FILE_REPLIES[i]);
+                file = file || (message.compare(0, n, FILE_REPLIES[i]) == 0 && message.size() > n &&
+                                message[n] == ' ');
+            }
+            if (!file) {
+                size_t end = message.find('\n');
+                return end == std::string::npos ? 0 : end + 1;
+            }
+            size_t pos = 0, sizePos = 0;
+            for (int field = 0; field < 4; field++) {
+                size_t end = message.find_first_of(" \n", pos);
+                if (end == std::string::npos) return 0;
+                if (message[end] == '\n') return end + 1;
+                sizePos = pos;
+                pos = end + 1;
+            }
+            char* end;
+            unsigned long long size = strtoull(message.c_str() + sizePos, &end, 10);
+            if (end != message.c_str() + pos - 1 || size > MAX_FILE_SIZE) {
+                return pos;     // not a file size: the caller rejects the reply
+            }
+            return pos + size;
+        }
+    }
+
+    std::string receiveTCPReply(int sock) {
+        char buffer[BUFFER_SIZE];
+        std::string message;
+        size_t length = 0;
+        while (length == 0) {
+            ssize_t received = read(sock, buffer, sizeof(buffer));
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) {
+                std::cerr << "Connection closed before the end of the reply\n";
+                return message;
+            }
+            message.append(buffer, received);
+            length = replyLength(message);
+        }
+
+        // Whatever follows the data (a final newline) is left unread
+        size_t have = std::min(message.size(), length);
+        if (length > message.capacity()) message.reserve(length);
+        message.resize(length);
+        while (have < length) {
+            ssize_t received = read(sock, &message[have], length - have);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) {
+                std::cerr << "Connection closed after " << have << " of " << length << " bytes\n";
+                message.resize(have);
+                break;
+            }
+            have += received;
+        }
+        return message;
+    }
+
     void sendUDPMessage(int sock, const std::string& message, struct sockaddr_in* client_addr, socklen_t addrlen) {
         ssize_t n = sendto(sock, message.c_str(), message.size(), 0, (struct sockaddr*)client_addr, addrlen);
         if (n == -1) {
@@ -96,8 +175,358 @@ namespace protocols {
 
         if (n >= 0 && n < BUFFER_SIZE) {
             buffer[n] = '\0';
-            return std::string(buffer);
+            return std::string(buffer, n);
         }
         return "Failed to receive UDP message.\n";
     }
-}
\ No newline at end of file
+
+    bool sendWithFds(int sock, const std::string& payload, const std::vector<int>& fds) {
+        if (fds.empty() || fds.size() > MAX_PASSED_FDS) return false;
+        std::string message(4, '\0');
+        uint32_t length = payload.size();
+        memcpy(&message[0], &length, sizeof(length));
+        message += payload;
+
+        char control[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+        memset(control, 0, sizeof(control));
+        struct iovec iov;
+        iov.iov_base = &message[0];
+        iov.iov_len = message.size();
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+
+        ssize_t sent;
+        while ((sent = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+        if (sent <= 0) return false;
+
+        // The rest without descriptors
+        size_t total = sent;
+        while (total < message.size()) {
+            sent = send(sock, message.data() + total, message.size() - total, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            total += sent;
+        }
+        return true;
+    }
+
+    bool receiveWithFds(int sock, std::string& payload, std::vector<int>& fds) {
+        char buffer[BUFFER_SIZE];
+        char control[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+        struct iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n;
+        while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+        if (n <= 0) return false;
+
+        fds.clear();
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fds.push_back(fd);
+            }
+        }
+
+        std::string message(buffer, n);
+        auto complete = [&message]() {
+            uint32_t length;
+            if (message.size() < sizeof(length)) return false;
+            memcpy(&length, message.data(), sizeof(length));
+            return message.size() >= sizeof(length) + length;
+        };
+        while (!complete()) {
+            n = read(sock, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                for (size_t i = 0; i < fds.size(); i++) close(fds[i]);
+                fds.clear();
+                return false;
+            }
+            message.append(buffer, n);
+        }
+        payload = message.substr(4);
+        return !fds.empty();
+    }
+
+    namespace {
+        const char COLORS[] = {'R', 'G', 'B', 'Y', 'O', 'P'};
+        const char* STATUS_NAMES[] = {"OK", "NOK", "ERR", "DUP", "INV", "ENT", "ETM", "ACT", "FIN", "EMPTY", "BSY"};
+        const char* REQUEST_NAMES[] = {"", REQUEST_START, REQUEST_TRY, REQUEST_QUIT, REQUEST_DEBUG,
+                                       REQUEST_SHOW_TRIALS, REQUEST_SCOREBOARD, REQUEST_HINT};
+        const char* RESPONSE_NAMES[] = {"", RESPONSE_START, RESPONSE_TRY, RESPONSE_QUIT, RESPONSE_DEBUG,
+                                        RESPONSE_SHOW_TRIALS, RESPONSE_SCOREBOARD, RESPONSE_HINT};
+        const int NUM_OPCODES = 7;
+
+        BinaryHeader emptyHeader(uint8_t opcode) {
+            BinaryHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = BINARY_MAGIC;
+            header.version = BINARY_VERSION;
+            header.opcode = opcode;
+            header.code = htons(NO_CODE);
+            return header;
+        }
+
+        std::string frame(const BinaryHeader& header, const std::string& data = "") {
+            std::string out(reinterpret_cast<const char*>(&header), sizeof(header));
+            return out + data;
+        }
+
+        // Splits at most max space separated tokens, the last one gets the rest
+        std::vector<std::string> tokens(const std::string& text, size_t max) {
+            std::vector<std::string> out;
+            size_t pos = 0;
+            while (pos < text.size() && out.size() + 1 < max) {
+                size_t end = text.find_first_of(" \n", pos);
+                if (end == std::string::npos) end = text.size();
+                if (end > pos) out.push_back(text.substr(pos, end - pos));
+                if (end < text.size() && text[end] == '\n') return out;
+                pos = end + 1;
+            }
+            if (pos < text.size()) out.push_back(text.substr(pos));
+            return out;
+        }
+
+        std::string plidString(uint32_t plid) {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "%06u", plid);
+            return buf;
+        }
+
+        int statusIndex(const std::string& status) {
+            for (int i = BS_OK; i <= BS_BSY; i++) {
+                if (status == STATUS_NAMES[i]) return i;
+            }
+            return -1;
+        }
+    }
+
+    uint16_t packCode(const std::string& colors) {
+        int code = 0, pegs = 0;
+        for (size_t i = 0; i < colors.size(); i++) {
+            if (colors[i] == ' ' || colors[i] == '\n') continue;
+            const char* c = std::find(COLORS, COLORS + 6, colors[i]);
+            if (c == COLORS + 6 || ++pegs > 4) return NO_CODE;
+            code = code * 6 + (c - COLORS);
+        }
+        return pegs == 4 ? code : NO_CODE;
+    }
+
+    std::string unpackCode(uint16_t code) {
+        if (code >= 1296) return "";
+        std::string colors = "R R R R";
+        for (int i = 3; i >= 0; i--) {
+            colors[i * 2] = COLORS[code % 6];
+            code /= 6;
+        }
+        return colors;
+    }
+
+    const char* binaryCommandName(uint8_t opcode) {
+        return opcode >= OP_SNG && opcode <= OP_HNT ? REQUEST_NAMES[opcode] : "";
+    }
+
+    bool isBinaryFrame(const std::string& message) {
+        return !message.empty() && static_cast<uint8_t>(message[0]) == BINARY_MAGIC;
+    }
+
+    bool decodeBinaryHeader(const std::string& frame, BinaryHeader& header) {
+        if (frame.size() < sizeof(BinaryHeader)) return false;
+        memcpy(&header, frame.data(), sizeof(header));
+        return header.magic == BINARY_MAGIC && header.version == BINARY_VERSION;
+    }
+
+    bool decodeBinaryRequest(const std::string& frame, BinaryHeader& header) {
+        return frame.size() == sizeof(BinaryHeader) && decodeBinaryHeader(frame, header) &&
+               header.length == 0;
+    }
+
+    std::string encodeBinaryRequest(const std::string& request, uint16_t seq) {
+        std::vector<std::string> t = tokens(request, 8);
+        if (t.empty()) return "";
+
+        int op = 0;
+        for (int i = 1; i <= NUM_OPCODES; i++) {
+            if (t[0] == REQUEST_NAMES[i]) op = i;
+        }
+        if (op == 0) return "";
+
+        BinaryHeader header = emptyHeader(op);
+        header.seq = htons(seq);
+        if (op != OP_SSB) {
+            if (t.size() < 2) return "";
+            header.plid = htonl(strtoul(t[1].c_str(), nullptr, 10));
+        }
+        if ((op == OP_SNG || op == OP_DBG) && t.size() >= 3) {
+            header.time = htons(atoi(t[2].c_str()));
+        }
+        if (op == OP_TRY && t.size() == 7) {
+            header.code = htons(packCode(t[2] + t[3] + t[4] + t[5]));
+            header.nT = atoi(t[6].c_str());
+        }
+        if (op == OP_DBG && t.size() == 7) {
+            header.code = htons(packCode(t[3] + t[4] + t[5] + t[6]));
+        }
+        return frame(header);
+    }
+
+    std::string binaryRequestToText(const std::string& frame) {
+        BinaryHeader header;
+        if (!decodeBinaryHeader(frame, header) || header.opcode < OP_SNG || header.opcode > OP_HNT) {
+            return "";
+        }
+        std::string text = REQUEST_NAMES[header.opcode];
+        if (header.opcode != OP_SSB) text += " " + plidString(ntohl(header.plid));
+        if (header.opcode == OP_SNG || header.opcode == OP_DBG) {
+            text += " " + std::to_string(ntohs(header.time));
+        }
+        if (header.opcode == OP_TRY || header.opcode == OP_DBG) {
+            text += " " + unpackCode(ntohs(header.code));
+        }
+        if (header.opcode == OP_TRY) text += " " + std::to_string(header.nT);
+        return text + "\n";
+    }
+
+    std::string encodeBinaryResponse(const std::string& response, const BinaryHeader& request) {
+        std::vector<std::string> t = tokens(response, 5);
+        BinaryHeader header = emptyHeader(OP_ERR);
+        header.plid = request.plid;
+        header.seq = request.seq;
+        header.status = BS_ERR;
+        if (t.size() < 2) return frame(header);
+
+        int status = statusIndex(t[1]);
+        for (int i = 1; i <= NUM_OPCODES; i++) {
+            if (t[0] == RESPONSE_NAMES[i]) header.opcode = 0x80 + i;
+        }
+        if (header.opcode == OP_ERR || status < 0) return frame(header);
+        header.status = status;
+
+        std::string data;
+        switch (header.opcode) {
+        case OP_RTR:
+            if (status == BS_OK && t.size() >= 5) {
+                header.nT = atoi(t[2].c_str());
+                header.feedback = (atoi(t[3].c_str()) << 4) | atoi(t[4].c_str());
+            } else if (status == BS_ENT || status == BS_ETM) {
+                header.code = htons(packCode(response.substr(8)));
+            }
+            break;
+        case OP_RQT:
+        case OP_RHN:
+            if (status == BS_OK) header.code = htons(packCode(response.substr(7)));
+            break;
+        case OP_RST:
+        case OP_RSS:
+            if (t.size() == 5) {
+                // t[4] is "Fdata", possibly followed by a trailing newline
+                size_t size = strtoul(t[3].c_str(), nullptr, 10);
+                data = t[2] + '\0' + t[4].substr(0, size);
+                header.length = htonl(data.size());
+            }
+            break;
+        }
+        return frame(header, data);
+    }
+
+    std::string binaryResponseToText(const std::string& frame) {
+        BinaryHeader header;
+        if (!decodeBinaryHeader(frame, header)) return "";
+        if (header.opcode < OP_RSG || header.opcode > OP_RHN || header.status > BS_BSY) {
+            return "ERR\n";
+        }
+        std::string text = std::string(RESPONSE_NAMES[header.opcode - 0x80]) + " " +
+                           STATUS_NAMES[header.status];
+        uint16_t code = ntohs(header.code);
+        if (header.opcode == OP_RTR && header.status == BS_OK) {
+            text += " " + std::to_string(header.nT) + " " + std::to_string(header.feedback >> 4) +
+                    " " + std::to_string(header.feedback & 0xF);
+        } else if (code != NO_CODE) {
+            text += " " + unpackCode(code);
+        }
+        if (header.length > 0) {
+            std::string data = frame.substr(sizeof(BinaryHeader));
+            size_t nul = data.find('\0');
+            if (nul != std::string::npos) {
+                std::string content = data.substr(nul + 1);
+                text += " " + data.substr(0, nul) + " " + std::to_string(content.size()) + " " + content;
+                return text;
+            }
+        }
+        return text + "\n";
+    }
+
+    std::vector<std::string> packBatches(const std::vector<std::string>& requests, size_t maxSize) {
+        std::vector<std::string> batches;
+        std::string body;
+        int count = 0;
+        auto header = [](int n) { return std::string(REQUEST_BATCH) + " " + std::to_string(n) + "\n"; };
+
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (count > 0 && (count == MAX_BATCH_REQUESTS ||
+                              header(count + 1).size() + body.size() + requests[i].size() > maxSize)) {
+                batches.push_back(header(count) + body);
+                body.clear();
+                count = 0;
+            }
+            body += requests[i];
+            count++;
+        }
+        if (count > 0) batches.push_back(header(count) + body);
+        return batches;
+    }
+
+    std::vector<std::string> unpackBatchResponse(const std::string& reply) {
+        std::vector<std::string> responses;
+        int count;
+        if (sscanf(reply.c_str(), "RBT OK %d", &count) != 1) return responses;
+
+        size_t pos = reply.find('\n');
+        while (pos != std::string::npos && (int)responses.size() < count) {
+            size_t end = reply.find('\n', pos + 1);
+            if (end == std::string::npos) break;
+            responses.push_back(reply.substr(pos + 1, end - pos));
+            pos = end;
+        }
+        if ((int)responses.size() != count) responses.clear();
+        return responses;
+    }
+
+    RttEstimator::RttEstimator() : srtt(0), rttvar(0), rto(RTO_INITIAL_MS), measured(false) {}
+
+    void RttEstimator::sample(double ms) {
+        if (!measured) {
+            srtt = ms;
+            rttvar = ms / 2;
+            measured = true;
+        } else {
+            rttvar = 0.75 * rttvar + 0.25 * std::fabs(srtt - ms);
+            srtt = 0.875 * srtt + 0.125 * ms;
+        }
+        rto = std::min<double>(std::max<double>(srtt + 4 * rttvar, RTO_MIN_MS), RTO_MAX_MS);
+    }
+
+    void RttEstimator::backoff() {
+        rto = std::min<double>(rto * 2, RTO_MAX_MS);
+    }
+}
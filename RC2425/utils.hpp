@@ -17,15 +17,32 @@
 #include <fstream>
 #include <cstdio>
 #include <sys/stat.h>
+#include <stdint.h>
 
 namespace protocols {
 
     // Common send/receive functions
     void sendTCPMessage(int sock, const std::string& message);
+    // Reads a request: text up to the newline, binary frames up to their
+    // header (a header that does not decode or announces trailing bytes is
+    // returned as it is, for the caller to reject)
     std::string receiveTCPMessage(int sock);
+    // Reads a whole TCP reply: "CMD status Fname Fsize Fdata" replies up to
+    // their Fsize data bytes, read straight into a buffer allocated once,
+    // binary frames up to their length and the others up to the newline.
+    // A reply cut short by the peer is returned as far as it got
+    std::string receiveTCPReply(int sock);
     void sendUDPMessage(int sock, const std::string& message, struct sockaddr_in* client_addr, socklen_t addrlen);
     std::string receiveUDPMessage(int sockfd, struct sockaddr_in* client_addr, socklen_t* addrlen);
 
+    // Descriptor passing over Unix stream sockets (SCM_RIGHTS), used to hand
+    // the GS sockets over to a new process. The payload is sent after its
+    // 4 byte length, the descriptors travel with the first byte.
+    bool sendWithFds(int sock, const std::string& payload, const std::vector<int>& fds);
+    // Receives a sendWithFds message (at most MAX_PASSED_FDS descriptors)
+    bool receiveWithFds(int sock, std::string& payload, std::vector<int>& fds);
+    const size_t MAX_PASSED_FDS = 8;
+
     // Response status codes
     const std::string OK = "OK";
     const std::string NOK = "NOK";
@@ -37,6 +54,90 @@ namespace protocols {
     const std::string ACT = "ACT";
     const std::string FIN = "FIN";
     const std::string EMPTY = "EMPTY";
+    const std::string BSY = "BSY";
+
+    // Binary protocol
+    //
+    // Fixed 20 byte header, recognized by its first byte, accepted on the
+    // same UDP/TCP ports as the text protocol. Requests and replies use the
+    // same header; replies echo plid and seq so a client can match them.
+    // STR/SSB replies carry "Fname\0Fdata" as `length` trailing bytes.
+    const uint8_t BINARY_MAGIC = 0xB7;
+    const uint8_t BINARY_VERSION = 1;
+    const uint16_t NO_CODE = 0xFFFF;
+
+    enum BinaryOpcode {
+        OP_SNG = 1, OP_TRY, OP_QUT, OP_DBG, OP_STR, OP_SSB, OP_HNT,
+        OP_RSG = 0x81, OP_RTR, OP_RQT, OP_RDB, OP_RST, OP_RSS, OP_RHN,
+        OP_ERR = 0xFF
+    };
+
+    enum BinaryStatus {
+        BS_OK, BS_NOK, BS_ERR, BS_DUP, BS_INV, BS_ENT, BS_ETM, BS_ACT, BS_FIN, BS_EMPTY, BS_BSY
+    };
+
+    struct __attribute__((packed)) BinaryHeader {
+        uint8_t magic;
+        uint8_t version;
+        uint8_t opcode;
+        uint8_t status;     // replies only
+        uint32_t plid;      // network order
+        uint16_t seq;       // network order, echoed by the reply
+        uint16_t time;      // network order, SNG/DBG max play time
+        uint16_t code;      // network order, packed colors (guess, secret or hint)
+        uint8_t nT;         // trial number
+        uint8_t feedback;   // nB << 4 | nW
+        uint32_t length;    // network order, trailing bytes
+    };
+
+    // "R G B Y" <-> base 6 code (colors in R G B Y O P order), NO_CODE if invalid
+    uint16_t packCode(const std::string& colors);
+    std::string unpackCode(uint16_t code);
+
+    // Text command of a request opcode ("TRY" for OP_TRY), "" if unknown
+    const char* binaryCommandName(uint8_t opcode);
+    bool isBinaryFrame(const std::string& message);
+    bool decodeBinaryHeader(const std::string& frame, BinaryHeader& header);
+    // Requests are a bare header: false also when length is not 0 or the
+    // frame holds more bytes
+    bool decodeBinaryRequest(const std::string& frame, BinaryHeader& header);
+
+    // Text request/reply <-> binary frame, "" when the message has no
+    // binary form
+    std::string encodeBinaryRequest(const std::string& request, uint16_t seq);
+    std::string binaryRequestToText(const std::string& frame);
+    std::string encodeBinaryResponse(const std::string& response, const BinaryHeader& request);
+    std::string binaryResponseToText(const std::string& frame);
+
+    // Batching (BAT/RBT, UDP only)
+    // Packs newline terminated text requests, in order, into as few "BAT N"
+    // datagrams of at most maxSize bytes (and MAX_BATCH_REQUESTS requests) as possible
+    std::vector<std::string> packBatches(const std::vector<std::string>& requests, size_t maxSize);
+    // Responses of an "RBT OK N" reply in request order, empty if it is not one
+    std::vector<std::string> unpackBatchResponse(const std::string& reply);
+
+    // Retransmission timeout from the measured round trip times (RFC 6298):
+    // smoothed RTT and RTT variance, RTO = SRTT + 4 * RTTVAR within
+    // [RTO_MIN_MS, RTO_MAX_MS], doubled on every retransmission
+    class RttEstimator {
+    public:
+        RttEstimator();
+        // RTT of a reply to a request sent only once (Karn's rule)
+        void sample(double ms);
+        // Called after a retransmission, until the next sample
+        void backoff();
+        int timeout() const { return static_cast<int>(rto); }
+
+        static const int RTO_INITIAL_MS = 500;
+        static const int RTO_MIN_MS = 50;
+        static const int RTO_MAX_MS = 2000;
+
+    private:
+        double srtt;
+        double rttvar;
+        double rto;
+        bool measured;
+    };
 }
 
 #endif
\ No newline at end of file